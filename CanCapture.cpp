@@ -0,0 +1,340 @@
+/*
+ * CanCapture.cpp
+ *
+ * Records the CAN traffic of all buses (received and sent frames) into a
+ * ring buffer in RAM. The recording can be started by a trigger frame, in
+ * which case the frames before the trigger remain in the ring too. The trace
+ * can be dumped via the serial console and replayed through the observers
+ * of the CanHandlers. A trace in candump format can be loaded line by line,
+ * so also traces recorded in the car with other tools can be replayed.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanCapture.h"
+
+CanCapture canCapture;
+
+CanCapture::CanCapture()
+{
+    state = STATE_IDLE;
+    head = count = 0;
+    triggerId = triggerMask = 0;
+    remaining = 0;
+    replayIndex = 0;
+    replaySpeed = 1;
+    replayStart = 0;
+}
+
+/*
+ * Clear the buffer and start recording. All frames are recorded into the ring until
+ * a frame matches the trigger, then postTrigger more frames are recorded and the
+ * capture stops. With a mask of 0 the first frame triggers the capture.
+ *
+ * \param triggerId - the id of the frame which triggers the capture
+ * \param triggerMask - the bits of the id which have to match
+ * \param postTrigger - number of frames to record after the trigger frame
+ */
+void CanCapture::start(uint32_t triggerId, uint32_t triggerMask, uint16_t postTrigger)
+{
+    noInterrupts();
+    head = count = 0;
+    this->triggerId = triggerId;
+    this->triggerMask = triggerMask;
+    remaining = postTrigger;
+    state = STATE_ARMED;
+    interrupts();
+
+    Logger::info("CAN capture armed, trigger id=%#x, mask=%#x, %d frames after trigger", triggerId, triggerMask, postTrigger);
+}
+
+/*
+ * Stop recording or replaying. The recorded frames remain in the buffer.
+ */
+void CanCapture::stop()
+{
+    noInterrupts();
+    state = STATE_IDLE;
+    interrupts();
+
+    Logger::info("CAN capture stopped, %d frames in buffer", count);
+}
+
+/*
+ * Stop recording or replaying and discard all recorded frames.
+ */
+void CanCapture::clear()
+{
+    noInterrupts();
+    state = STATE_IDLE;
+    head = count = 0;
+    interrupts();
+}
+
+/*
+ * Are frames recorded (waiting for the trigger or triggered) ?
+ */
+bool CanCapture::isRecording()
+{
+    return state == STATE_ARMED || state == STATE_TRIGGERED;
+}
+
+/*
+ * Check if no frames are waiting to be replayed.
+ */
+bool CanCapture::isIdle()
+{
+    return state != STATE_REPLAY;
+}
+
+/*
+ * Record a frame. Called by the CanHandlers for every received frame (in the
+ * CAN interrupt) and every frame handed to a tx mailbox. As the interrupts of
+ * the two buses may preempt each other, the entry is written in a critical section.
+ *
+ * \param bus - the bus on which the frame was seen
+ * \param frame - the frame
+ * \param transmit - true if the frame was sent by us
+ */
+void CanCapture::record(CanHandler::CanBusNode bus, CAN_FRAME *frame, bool transmit)
+{
+    uint32_t primask = enterCritical();
+
+    if (state == STATE_ARMED) {
+        if ((frame->id & triggerMask) == (triggerId & triggerMask)) {
+            state = STATE_TRIGGERED;
+        }
+    } else if (state == STATE_TRIGGERED) {
+        remaining--;
+    } else {
+        leaveCritical(primask);
+        return;
+    }
+
+    CanCaptureEntry *entry = &buffer[head];
+    entry->timestamp = Clock::micros();
+    entry->id = (frame->id & CAN_CAPTURE_ID_MASK) | (frame->extended ? CAN_CAPTURE_EXTENDED : 0) | (transmit ? CAN_CAPTURE_TX : 0);
+    entry->bus = bus;
+    entry->length = (frame->rtr ? 0 : min(frame->length, 8));
+    memcpy(entry->data, frame->data.bytes, 8);
+
+    head = (head + 1) % CFG_CAN_CAPTURE_SIZE;
+    if (count < CFG_CAN_CAPTURE_SIZE) {
+        count++;
+    }
+
+    if (state == STATE_TRIGGERED && remaining == 0) {
+        state = STATE_IDLE;
+    }
+
+    leaveCritical(primask);
+}
+
+/*
+ * Print the state of the capture.
+ */
+void CanCapture::printStatus()
+{
+    static const char *stateStr[] = { "idle", "waiting for trigger", "triggered", "replaying" };
+
+    Logger::console("CAN capture: %s, %d of %d frames in buffer", stateStr[state], count, CFG_CAN_CAPTURE_SIZE);
+}
+
+/*
+ * Get a recorded entry, index 0 is the oldest one.
+ */
+CanCapture::CanCaptureEntry *CanCapture::getEntry(uint16_t index)
+{
+    return &buffer[(head + CFG_CAN_CAPTURE_SIZE - count + index) % CFG_CAN_CAPTURE_SIZE];
+}
+
+/*
+ * Write the recorded frames to the serial port, oldest first.
+ *
+ * FORMAT_CANDUMP: "(seconds.microseconds) can<bus> <id>#<data>" per line, which can be
+ * read by canplayer/log2asc of can-utils. The direction is not part of this format.
+ * FORMAT_BINARY: "CCAP", version (1 byte), number of frames (2 bytes), then per frame
+ * the timestamp in microseconds (4 bytes), the id with the CAN_CAPTURE_* flags (4 bytes),
+ * the bus (1 byte, 0 = EV, 1 = car, 2 = internal), the length (1 byte) and 8 data bytes.
+ * All values are little endian.
+ */
+void CanCapture::dump(Format format)
+{
+    if (isRecording()) {
+        Logger::warn("stop the CAN capture before dumping it");
+        return;
+    }
+
+    if (format == FORMAT_BINARY) {
+        uint8_t header[7] = { 'C', 'C', 'A', 'P', 2, (uint8_t) (count & 0xff), (uint8_t) (count >> 8) };
+        SerialUSB.write(header, sizeof(header));
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        CanCaptureEntry *entry = getEntry(i);
+
+        if (format == FORMAT_BINARY) {
+            uint8_t record[18];
+            for (int j = 0; j < 4; j++) {
+                record[j] = (entry->timestamp >> (8 * j)) & 0xff;
+                record[4 + j] = (entry->id >> (8 * j)) & 0xff;
+            }
+            record[8] = entry->bus;
+            record[9] = entry->length;
+            memcpy(record + 10, entry->data, 8);
+            SerialUSB.write(record, sizeof(record));
+        } else {
+            char data[17];
+            for (int j = 0; j < entry->length; j++) {
+                sprintf(data + 2 * j, "%02X", entry->data[j]);
+            }
+            data[2 * entry->length] = 0;
+
+            Logger::console("(%lu.%06lu) can%d %0*lX#%s", entry->timestamp / 1000000, entry->timestamp % 1000000, entry->bus,
+                    (entry->id & CAN_CAPTURE_EXTENDED) ? 8 : 3, entry->id & CAN_CAPTURE_ID_MASK, data);
+        }
+    }
+}
+
+/*
+ * Convert a hex digit into its value, -1 if it's not a hex digit.
+ */
+int8_t CanCapture::hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Append a frame in candump format ("(1436509052.249713) can0 12345678#0011223344")
+ * to the buffer. Ids with more than 3 digits are extended. The frames are replayed
+ * as received frames on the bus with the same number.
+ *
+ * \retval true if the line was parsed successfully
+ */
+bool CanCapture::load(char *line)
+{
+    unsigned long seconds, micros;
+    int busNumber;
+    char text[32];
+
+    if (state != STATE_IDLE) {
+        Logger::warn("stop the CAN capture before loading frames");
+        return false;
+    }
+    if (sscanf(line, " (%lu.%lu) can%d %31s", &seconds, &micros, &busNumber, text) != 4) {
+        return false;
+    }
+    char *data = strchr(text, '#');
+    if (data == NULL || data == text) {
+        return false;
+    }
+    *data++ = 0;
+
+    CanCaptureEntry *entry = &buffer[head];
+    entry->timestamp = seconds * 1000000 + micros;
+    entry->id = (strtoul(text, NULL, 16) & CAN_CAPTURE_ID_MASK) | (strlen(text) > 3 ? CAN_CAPTURE_EXTENDED : 0);
+    entry->bus = constrain(busNumber, CanHandler::CAN_BUS_EV, CanHandler::CAN_BUS_INTERNAL);
+    entry->length = 0;
+    memset(entry->data, 0, 8);
+    while (entry->length < 8 && hexValue(data[0]) != -1 && hexValue(data[1]) != -1) {
+        entry->data[entry->length++] = (hexValue(data[0]) << 4) | hexValue(data[1]);
+        data += 2;
+    }
+
+    head = (head + 1) % CFG_CAN_CAPTURE_SIZE;
+    if (count < CFG_CAN_CAPTURE_SIZE) {
+        count++;
+    }
+    return true;
+}
+
+/*
+ * Start to feed the received frames of the buffer to the CanHandlers, which
+ * dispatch them to their observers like frames from the bus. Frames which
+ * were sent by us are skipped.
+ *
+ * \param speed - 1 = original timing, n = n times faster, 0 = as fast as possible
+ */
+void CanCapture::replay(uint16_t speed)
+{
+    if (isRecording()) {
+        stop();
+    }
+    if (count == 0) {
+        Logger::console("no CAN frames to replay");
+        return;
+    }
+    replayIndex = 0;
+    replaySpeed = speed;
+    replayStart = Clock::micros();
+    state = STATE_REPLAY;
+    Logger::info("replaying %d CAN frames", count);
+}
+
+/*
+ * Inject the frames which are due for replay. If the receive buffer of a
+ * CanHandler is full, the replay continues in the next loop.
+ */
+void CanCapture::process()
+{
+    if (state != STATE_REPLAY) {
+        return;
+    }
+
+    uint32_t firstTimestamp = getEntry(0)->timestamp;
+    uint64_t elapsed = (uint64_t) (Clock::micros() - replayStart) * replaySpeed;
+
+    while (replayIndex < count) {
+        CanCaptureEntry *entry = getEntry(replayIndex);
+
+        if (!(entry->id & CAN_CAPTURE_TX)) {
+            if (replaySpeed != 0 && elapsed < (uint32_t) (entry->timestamp - firstTimestamp)) {
+                return;
+            }
+
+            CAN_FRAME frame;
+            frame.id = entry->id & CAN_CAPTURE_ID_MASK;
+            frame.extended = (entry->id & CAN_CAPTURE_EXTENDED ? 1 : 0);
+            frame.rtr = 0;
+            frame.length = entry->length;
+            memcpy(frame.data.bytes, entry->data, 8);
+
+            if (!CanHandler::getHandler(entry->bus)->injectFrame(&frame)) {
+                return;
+            }
+        }
+        replayIndex++;
+    }
+
+    state = STATE_IDLE;
+    Logger::info("CAN replay finished");
+}
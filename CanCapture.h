@@ -0,0 +1,96 @@
+/*
+ * CanCapture.h
+ *
+ * Records the CAN traffic of both buses into a RAM buffer and replays it.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CANCAPTURE_H_
+#define CANCAPTURE_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "Logger.h"
+#include "Clock.h"
+#include "CriticalSection.h"
+
+// flags stored in the upper bits of CanCaptureEntry.id (CAN id's use max 29 bits)
+#define CAN_CAPTURE_EXTENDED    0x80000000 // the frame has an extended id
+#define CAN_CAPTURE_TX          0x40000000 // the frame was sent by us
+#define CAN_CAPTURE_ID_MASK     0x1fffffff
+
+class CanCapture
+{
+public:
+    enum Format {
+        FORMAT_CANDUMP, // text, one frame per line as written by "candump -L" (can-utils)
+        FORMAT_BINARY // header "CCAP", version and number of frames, then 18 bytes per frame (see dump())
+    };
+
+    CanCapture();
+    void start(uint32_t triggerId, uint32_t triggerMask, uint16_t postTrigger);
+    void stop();
+    void clear();
+    bool isRecording();
+    bool isIdle();
+    void record(CanHandler::CanBusNode bus, CAN_FRAME *frame, bool transmit);
+    void dump(Format format);
+    bool load(char *line);
+    void replay(uint16_t speed);
+    void process();
+    void printStatus();
+
+private:
+    enum State {
+        STATE_IDLE, // neither recording nor replaying
+        STATE_ARMED, // recording into the ring, waiting for the trigger frame
+        STATE_TRIGGERED, // trigger frame seen, recording the remaining frames
+        STATE_REPLAY // feeding the recorded frames to the CanHandlers
+    };
+    struct CanCaptureEntry {
+        uint32_t timestamp; // Clock::micros() when the frame was received or handed to a tx mailbox
+        uint32_t id; // the CAN id plus the CAN_CAPTURE_* flags
+        uint8_t bus; // the CanHandler::CanBusNode on which the frame was seen
+        uint8_t length; // the number of data bytes
+        uint8_t data[8];
+    };
+
+    CanCaptureEntry buffer[CFG_CAN_CAPTURE_SIZE]; // ring of recorded frames, the oldest ones are overwritten
+    uint16_t head; // next entry to write
+    uint16_t count; // number of valid entries
+    volatile State state;
+    uint32_t triggerId, triggerMask; // the frame which triggers the capture (id & mask == triggerId & mask)
+    uint16_t remaining; // number of frames still to record after the trigger
+    uint16_t replayIndex; // next entry to replay (0 = oldest)
+    uint16_t replaySpeed; // 1 = original timing, n = n times faster, 0 = as fast as possible
+    uint32_t replayStart; // Clock::micros() when the replay started
+
+    CanCaptureEntry *getEntry(uint16_t index);
+    static int8_t hexValue(char c);
+};
+
+extern CanCapture canCapture;
+
+#endif /* CANCAPTURE_H_ */
@@ -0,0 +1,174 @@
+/*
+ * CanCyclicFrame.cpp
+ *
+ * A CAN frame which is registered with a period and an optional phase. It is
+ * transmitted by the TickHandler directly from the timer interrupt, so the timing
+ * on the bus does not depend on the load of the main loop or the tick rate of the
+ * device which provides the payload. The device only updates the payload of the
+ * frame in place.
+ *
+ * Example:
+ *
+ *     keepAlive.start(&canHandlerCar, 50000); // send every 50ms
+ *     ...
+ *     keepAlive.frame.data.byte[1] = value; // single byte, no locking required
+ *     ...
+ *
+ * Frames with values which rarely change may use a long period as maximum refresh
+ * interval and call trigger() when a value changed significantly (e.g. more than a
+ * deadband compared to sentData). The frame is then sent right away and the periodic
+ * transmissions continue in their phase. The inhibit time limits the rate of such
+ * transmissions, a trigger within the inhibit time is delayed until it's over.
+ *
+ *     outputFrame.setInhibitTime(100000); // at most every 100ms
+ *     outputFrame.start(&canHandlerEv, 5000000); // at least every 5s
+ *     ...
+ *     if (abs(value - outputFrame.sentData.byte[0]) > deadband) {
+ *         outputFrame.frame.data.byte[0] = value;
+ *         outputFrame.trigger();
+ *     }
+ *     noInterrupts(); // multiple bytes must be changed consistently
+ *     keepAlive.frame.data.low = a;
+ *     keepAlive.frame.data.high = b;
+ *     interrupts();
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanCyclicFrame.h"
+
+CanCyclicFrame::CanCyclicFrame()
+{
+    canHandler = NULL;
+    priority = CanHandler::TX_PRIORITY_CONTROL;
+    replace = true;
+    interval = 0;
+    inhibitTime = 0;
+    lastTransmission = 0;
+    sentData.value = 0;
+    frame.length = 0;
+    frame.id = 0;
+    frame.extended = 0;
+    frame.rtr = 0;
+    frame.data.value = 0;
+}
+
+/*
+ * Start sending the frame periodically on a bus. The frame must be prepared before.
+ *
+ * \param handler - the CanHandler of the bus to send the frame on
+ * \param interval - the period in microseconds
+ * \param phase - offset of the transmission within the period in microseconds (see TickHandler::attach())
+ * \param priority - the priority in the transmit queue
+ * \param replace - a frame of the previous period which is still queued, is replaced (use false if frames share the id)
+ */
+void CanCyclicFrame::start(CanHandler *handler, uint32_t interval, uint32_t phase, CanHandler::TxPriority priority, bool replace)
+{
+    stop();
+    this->priority = priority;
+    this->replace = replace;
+    this->interval = interval;
+    lastTransmission = Clock::micros() - inhibitTime; // a trigger right after the start isn't delayed
+    canHandler = handler;
+    tickHandler.attach(this, interval, TickHandler::PRIORITY_INTERRUPT, phase);
+}
+
+/*
+ * Stop the periodic transmission.
+ */
+void CanCyclicFrame::stop()
+{
+    if (canHandler != NULL) {
+        tickHandler.detach(this);
+        canHandler = NULL;
+    }
+}
+
+/*
+ * Is the frame sent periodically ?
+ */
+bool CanCyclicFrame::isActive()
+{
+    return canHandler != NULL;
+}
+
+/*
+ * Set the minimum time between two transmissions in microseconds, which limits
+ * the rate of trigger() (0 = no limit). Must be called before start().
+ */
+void CanCyclicFrame::setInhibitTime(uint32_t inhibitTime)
+{
+    this->inhibitTime = inhibitTime;
+}
+
+/*
+ * Send the frame now because its payload changed. The next periodic transmission
+ * is the first one in the phase of the frame after the inhibit time.
+ * If the last transmission is more recent than the inhibit time, the frame
+ * is sent (with the payload of that time) as soon as the inhibit time is over.
+ * The transmission and the rescheduling are done in one critical section, so the
+ * timer interrupt can't send the frame in between.
+ */
+void CanCyclicFrame::trigger()
+{
+    if (canHandler == NULL) {
+        return;
+    }
+
+    uint32_t primask = enterCritical();
+    uint32_t elapsed = Clock::micros() - lastTransmission;
+    if (elapsed >= inhibitTime) {
+        send();
+        tickHandler.reschedule(this, inhibitTime, true);
+    } else {
+        tickHandler.reschedule(this, inhibitTime - elapsed);
+    }
+    leaveCritical(primask);
+}
+
+/*
+ * Called in the timer interrupt, queue the frame for transmission.
+ */
+void CanCyclicFrame::handleTick()
+{
+    if (canHandler != NULL) {
+        send();
+    }
+}
+
+/*
+ * Queue the frame and remember what was sent when.
+ */
+void CanCyclicFrame::send()
+{
+    uint32_t primask = enterCritical();
+    sentData.value = frame.data.value;
+    lastTransmission = Clock::micros();
+    leaveCritical(primask);
+    canHandler->sendFrame(frame, priority, replace);
+}
+
+char *CanCyclicFrame::getCommonName()
+{
+    return "CanCyclicFrame";
+}
@@ -0,0 +1,64 @@
+/*
+ * CanCyclicFrame.h
+ *
+ * A CAN frame which is transmitted periodically from the timer interrupt
+ * and additionally on demand when its payload changed.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CANCYCLICFRAME_H_
+#define CANCYCLICFRAME_H_
+
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+
+class CanCyclicFrame: public TickObserver
+{
+public:
+    CanCyclicFrame();
+    void start(CanHandler *handler, uint32_t interval, uint32_t phase = TickHandler::PHASE_AUTO,
+            CanHandler::TxPriority priority = CanHandler::TX_PRIORITY_CONTROL, bool replace = true);
+    void stop();
+    bool isActive();
+    void setInhibitTime(uint32_t inhibitTime);
+    void trigger();
+    void handleTick();
+    char *getCommonName();
+
+    CAN_FRAME frame; // the frame to send, the payload may be changed in place (multiple bytes with interrupts disabled)
+    BytesUnion sentData; // the payload of the last transmission (read it with interrupts disabled)
+
+private:
+    CanHandler *canHandler; // the bus on which the frame is sent, NULL if not active
+    CanHandler::TxPriority priority; // priority of the frame in the transmit queue
+    bool replace; // replace a queued frame with the same id (see CanHandler::sendFrame())
+    uint32_t interval; // the period in microseconds, the maximum time between two transmissions
+    uint32_t inhibitTime; // minimum time between two transmissions in microseconds (0 = no limit)
+    volatile uint32_t lastTransmission; // Clock::micros() of the last transmission
+
+    void send();
+};
+
+#endif /* CANCYCLICFRAME_H_ */
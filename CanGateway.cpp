@@ -0,0 +1,331 @@
+/*
+ * CanGateway.cpp
+ *
+ * Turns the GEVCU extension into a CAN to USB interface which is compatible
+ * with GVRET, so SavvyCAN can connect directly to the serial port.
+ * The gateway is started when the host sends 0xE7 (binary mode) and ends when
+ * the host closes the port. While it is active, all frames of both buses are
+ * received (the mailbox filters are opened) and streamed to the host, frames
+ * from the host are sent on the selected bus and no log output is written.
+ *
+ * The frames are encoded in the CAN interrupt into a ring buffer, which is
+ * written to SerialUSB in as large blocks as possible in process(), so a busy
+ * loop doesn't lose frames as long as the buffer doesn't overflow.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanGateway.h"
+
+CanGateway canGateway;
+
+CanGateway::CanGateway()
+{
+    outHead = outTail = 0;
+    commandLength = 0;
+    active = false;
+    forwarded = dropped = 0;
+    sent = bytesWritten = 0;
+    startTime = stopTime = 0;
+}
+
+/*
+ * Enter the binary mode: mute the log output, open the mailbox filters of
+ * both buses and start streaming the frames.
+ */
+void CanGateway::start()
+{
+    if (active) {
+        return;
+    }
+
+    Logger::setMuted(true);
+    noInterrupts();
+    outHead = outTail = 0;
+    forwarded = dropped = 0;
+    interrupts();
+    commandLength = 0;
+    sent = bytesWritten = 0;
+    startTime = Clock::millis();
+
+    canHandlerEv.setPromiscuous(true);
+    canHandlerCar.setPromiscuous(true);
+    active = true;
+}
+
+/*
+ * Leave the binary mode and return to the serial console.
+ */
+void CanGateway::stop()
+{
+    if (!active) {
+        return;
+    }
+
+    active = false;
+    stopTime = Clock::millis();
+    canHandlerEv.setPromiscuous(false);
+    canHandlerCar.setPromiscuous(false);
+    Logger::setMuted(false);
+
+    Logger::info("GVRET gateway stopped");
+    printStatistics();
+}
+
+/*
+ * Is the gateway streaming frames to the host ?
+ */
+bool CanGateway::isActive()
+{
+    return active;
+}
+
+/*
+ * Check if no data is waiting to be written to the host.
+ */
+bool CanGateway::isIdle()
+{
+    return outHead == outTail;
+}
+
+/*
+ * Copy data to the output buffer if there's enough space for all of it.
+ * The buffer is filled in a critical section, so the data of one caller is never
+ * interleaved with the data of an interrupt (e.g. of the other bus).
+ */
+bool CanGateway::put(uint8_t *data, uint8_t length)
+{
+    uint32_t primask = enterCritical();
+    uint16_t head = outHead;
+    uint16_t free = (outTail + CFG_CAN_GATEWAY_BUFFER_SIZE - head - 1) % CFG_CAN_GATEWAY_BUFFER_SIZE;
+
+    if (free < length) {
+        leaveCritical(primask);
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        outBuffer[head] = data[i];
+        head = (head + 1) % CFG_CAN_GATEWAY_BUFFER_SIZE;
+    }
+    outHead = head;
+    leaveCritical(primask);
+    return true;
+}
+
+/*
+ * Queue a response to a command of the host.
+ */
+void CanGateway::respond(uint8_t *data, uint8_t length)
+{
+    put(data, length);
+}
+
+void CanGateway::putUInt32(uint8_t *buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+uint32_t CanGateway::getUInt32(uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t) buffer[3] << 24);
+}
+
+/*
+ * Encode a frame which was seen on a bus for the host (F1 00, timestamp, id with
+ * bit 31 set for extended frames, length + bus << 4, data, checksum).
+ * The internal bus is reported as bus 2.
+ * Called by the CanHandlers in the CAN interrupt or from the main loop.
+ * If the buffer is full, the frame is dropped and counted.
+ */
+void CanGateway::forward(CanHandler::CanBusNode bus, CAN_FRAME *frame)
+{
+    uint8_t buffer[20];
+    uint8_t length = (frame->rtr ? 0 : min(frame->length, 8));
+
+    buffer[0] = GVRET_COMMAND;
+    buffer[1] = CMD_BUILD_CAN_FRAME;
+    putUInt32(buffer + 2, Clock::micros());
+    putUInt32(buffer + 6, frame->id | (frame->extended ? 0x80000000 : 0));
+    buffer[10] = length | (bus << 4);
+    memcpy(buffer + 11, frame->data.bytes, length);
+    buffer[11 + length] = 0;
+
+    uint32_t primask = enterCritical();
+    if (put(buffer, 12 + length)) {
+        forwarded++;
+    } else {
+        dropped++;
+    }
+    leaveCritical(primask);
+}
+
+/*
+ * Write the buffered frames to the host and handle its commands.
+ * The gateway stops when the host closes the port.
+ */
+void CanGateway::process()
+{
+    if (!active) {
+        return;
+    }
+
+    while (SerialUSB.available()) {
+        handleInput(SerialUSB.read());
+    }
+
+    uint16_t head = outHead;
+    while (outTail != head) {
+        uint16_t length = (head > outTail ? head : CFG_CAN_GATEWAY_BUFFER_SIZE) - outTail;
+        SerialUSB.write(outBuffer + outTail, length);
+        bytesWritten += length;
+        outTail = (outTail + length) % CFG_CAN_GATEWAY_BUFFER_SIZE;
+    }
+
+    if (!SerialUSB) {
+        stop();
+    }
+}
+
+/*
+ * Collect the bytes of a command and handle it when it's complete.
+ * Bytes outside of a command (e.g. repeated 0xE7) are ignored.
+ */
+void CanGateway::handleInput(uint8_t data)
+{
+    if (commandLength == 0 && data != GVRET_COMMAND) {
+        return;
+    }
+    command[commandLength++] = data;
+
+    int8_t length = getCommandLength();
+    if (length != -1 && commandLength >= length) {
+        handleCommand();
+        commandLength = 0;
+    }
+}
+
+/*
+ * Get the total length of the command in command[] (incl. 0xF1 and the
+ * command byte), -1 if it's not known yet.
+ */
+int8_t CanGateway::getCommandLength()
+{
+    if (commandLength < 2) {
+        return -1;
+    }
+    switch (command[1]) {
+    case CMD_BUILD_CAN_FRAME:
+    case CMD_ECHO_CAN_FRAME:
+        // id (4), bus (1), length (1), data, checksum (1)
+        return (commandLength < 8 ? -1 : 9 + min(command[7] & 0x0f, 8));
+    case CMD_SET_DIG_OUTPUTS:
+    case CMD_SET_SINGLEWIRE_MODE:
+    case CMD_SET_SYSTEM_TYPE:
+        return 3;
+    case CMD_SETUP_CANBUS:
+        return 10;
+    case CMD_SET_EXT_BUSES:
+        return 14;
+    default:
+        return 2;
+    }
+}
+
+/*
+ * Execute a complete command of the host and queue the response.
+ * The bus speeds can't be changed by the host, setup requests are ignored.
+ */
+void CanGateway::handleCommand()
+{
+    uint8_t response[17];
+    CAN_FRAME frame;
+
+    memset(response, 0, sizeof(response));
+    response[0] = GVRET_COMMAND;
+    response[1] = command[1];
+
+    switch (command[1]) {
+    case CMD_BUILD_CAN_FRAME:
+    case CMD_ECHO_CAN_FRAME:
+        frame.id = getUInt32(command + 2) & 0x1fffffff;
+        frame.extended = (command[5] & 0x80 ? 1 : 0);
+        frame.rtr = 0;
+        frame.length = min(command[7] & 0x0f, 8);
+        frame.data.value = 0;
+        memcpy(frame.data.bytes, command + 8, frame.length);
+        if (command[1] == CMD_ECHO_CAN_FRAME) {
+            forward((CanHandler::CanBusNode) constrain(command[6], CanHandler::CAN_BUS_EV, CanHandler::CAN_BUS_INTERNAL), &frame);
+        } else {
+            CanHandler::getHandler(command[6])->sendFrame(frame);
+            sent++;
+        }
+        break;
+    case CMD_TIME_SYNC:
+        putUInt32(response + 2, Clock::micros());
+        respond(response, 6);
+        break;
+    case CMD_GET_DIG_INPUTS:
+        respond(response, 4);
+        break;
+    case CMD_GET_ANALOG_INPUTS:
+        respond(response, 17);
+        break;
+    case CMD_GET_CANBUS_PARAMS:
+        response[2] = 1; // enabled, not listen-only
+        putUInt32(response + 3, CFG_CAN0_SPEED);
+        response[7] = 1;
+        putUInt32(response + 8, CFG_CAN1_SPEED);
+        respond(response, 12);
+        break;
+    case CMD_GET_DEVICE_INFO:
+        response[2] = 1; // build number (2 bytes)
+        response[4] = 1; // eeprom version
+        respond(response, 8);
+        break;
+    case CMD_KEEPALIVE:
+        response[2] = 0xDE;
+        response[3] = 0xAD;
+        respond(response, 4);
+        break;
+    case CMD_GET_NUMBUSES:
+        response[2] = 3; // EV, car and internal bus
+        respond(response, 3);
+        break;
+    case CMD_GET_EXT_BUSES:
+        respond(response, 17);
+        break;
+    }
+}
+
+/*
+ * Print the number of forwarded and lost frames and the throughput of the last session.
+ */
+void CanGateway::printStatistics()
+{
+    uint32_t duration = ((active ? Clock::millis() : stopTime) - startTime) / 1000;
+
+    Logger::console("GVRET gateway: %d frames forwarded, %d dropped (buffer full), %d sent, %d bytes written (%d bytes/sec)", forwarded, dropped,
+            sent, bytesWritten, (duration == 0 ? bytesWritten : bytesWritten / duration));
+}
@@ -0,0 +1,94 @@
+/*
+ * CanGateway.h
+ *
+ * Streams the frames of both CAN buses to SerialUSB in the binary GVRET protocol.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CANGATEWAY_H_
+#define CANGATEWAY_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "Logger.h"
+#include "Clock.h"
+#include "CriticalSection.h"
+
+#define GVRET_START_BINARY      0xE7 // switches GVRET into binary mode
+#define GVRET_COMMAND           0xF1 // start of a command / frame
+
+class CanGateway
+{
+public:
+    enum Command {
+        CMD_BUILD_CAN_FRAME = 0x00,
+        CMD_TIME_SYNC = 0x01,
+        CMD_GET_DIG_INPUTS = 0x02,
+        CMD_GET_ANALOG_INPUTS = 0x03,
+        CMD_SET_DIG_OUTPUTS = 0x04,
+        CMD_SETUP_CANBUS = 0x05,
+        CMD_GET_CANBUS_PARAMS = 0x06,
+        CMD_GET_DEVICE_INFO = 0x07,
+        CMD_SET_SINGLEWIRE_MODE = 0x08,
+        CMD_KEEPALIVE = 0x09,
+        CMD_SET_SYSTEM_TYPE = 0x0A,
+        CMD_ECHO_CAN_FRAME = 0x0B,
+        CMD_GET_NUMBUSES = 0x0C,
+        CMD_GET_EXT_BUSES = 0x0D,
+        CMD_SET_EXT_BUSES = 0x0E
+    };
+
+    CanGateway();
+    void start();
+    void stop();
+    bool isActive();
+    bool isIdle();
+    void forward(CanHandler::CanBusNode bus, CAN_FRAME *frame);
+    void process();
+    void printStatistics();
+
+private:
+    uint8_t outBuffer[CFG_CAN_GATEWAY_BUFFER_SIZE]; // ring of encoded frames and responses waiting to be written to SerialUSB
+    volatile uint16_t outHead; // only modified in a critical section
+    uint16_t outTail; // only modified by process()
+    uint8_t command[24]; // the command which is currently received from the host
+    uint8_t commandLength; // number of bytes in command[]
+    volatile bool active;
+    volatile uint32_t forwarded, dropped; // frames written to the buffer / lost because the buffer was full
+    uint32_t sent, bytesWritten; // frames sent on behalf of the host, bytes written to SerialUSB
+    uint32_t startTime, stopTime; // Clock::millis() when the gateway was started / stopped
+
+    bool put(uint8_t *data, uint8_t length);
+    void respond(uint8_t *data, uint8_t length);
+    void handleInput(uint8_t data);
+    int8_t getCommandLength();
+    void handleCommand();
+    static void putUInt32(uint8_t *buffer, uint32_t value);
+    static uint32_t getUInt32(uint8_t *buffer);
+};
+
+extern CanGateway canGateway;
+
+#endif /* CANGATEWAY_H_ */
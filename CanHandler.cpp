@@ -4,6 +4,19 @@
  * Devices may register to this handler in order to receive CAN frames (publish/subscribe)
  * and they can also use this class to send messages.
  *
+ * Besides the two physical buses there is an internal bus (canHandlerInternal) on which
+ * the devices exchange their values as CAN frames instead of calling each other.
+ * Frames sent on it are looped back into its receive buffer and dispatched like
+ * received frames, so the traffic can be captured, forwarded and measured like the
+ * traffic of a real bus. The load is calculated as if it ran at the speed of CAN0.
+ *
+ * Selected frames can be routed from one bus to another (e.g. from the EV bus to the
+ * SW-CAN bus of the car). The routes are checked in the receive interrupt and the
+ * frames are queued directly to the destination bus without involving a device.
+ * To keep a fast bus from flooding a slow one, a route can be limited to one frame
+ * per interval and a routed frame which is still queued is replaced by a newer one
+ * with the same id (frames queued by devices are never replaced by a route).
+ *
 Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
 Permission is hereby granted, free of charge, to any person obtaining
@@ -28,9 +41,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "CanHandler.h"
+#include "CanCapture.h"
+#include "CanGateway.h"
 
 CanHandler canHandlerEv = CanHandler(CanHandler::CAN_BUS_EV);
 CanHandler canHandlerCar = CanHandler(CanHandler::CAN_BUS_CAR);
+CanHandler canHandlerInternal = CanHandler(CanHandler::CAN_BUS_INTERNAL);
 
 /*
  * Constructor of the can handler
@@ -42,13 +58,57 @@ CanHandler::CanHandler(CanBusNode canBusNode)
     // assign the correct bus instance to the pointer
     if (canBusNode == CAN_BUS_CAR) {
         bus = &CAN2;
+        bitRate = CFG_CAN1_SPEED;
+    } else if (canBusNode == CAN_BUS_INTERNAL) {
+        bus = NULL;
+        bitRate = CFG_CAN0_SPEED;
     } else {
         bus = &CAN;
+        bitRate = CFG_CAN0_SPEED;
     }
 
     for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
         observerData[i].observer = NULL;
     }
+    rebuildIndex();
+    filterCount = 0;
+    numRxMailboxes = 0;
+    promiscuous = false;
+    routeCount = 0;
+    rxHead = rxTail = 0;
+    overrunCount = 0;
+    reportedOverrunCount = 0;
+    receiveTime = 0;
+    for (int i = 0; i < NUM_TX_PRIORITIES; i++) {
+        txHead[i] = txTail[i] = 0;
+    }
+    txDepth = 0;
+    windowBits = 0;
+    windowStart = 0;
+    for (int i = 0; i < CFG_CAN_LOAD_WINDOWS; i++) {
+        loadBits[i] = 0;
+        loadTime[i] = 0;
+    }
+    loadIndex = 0;
+    load = 0;
+    lastStatus = 0;
+    resetStatistics();
+}
+
+/*
+ * Get the handler of a bus by its number (0 = EV, 1 = car, 2 = internal),
+ * invalid numbers return the EV bus.
+ */
+CanHandler *CanHandler::getHandler(uint8_t busNumber)
+{
+    switch (busNumber) {
+    case CAN_BUS_CAR:
+        return &canHandlerCar;
+    case CAN_BUS_INTERNAL:
+        return &canHandlerInternal;
+    default:
+        return &canHandlerEv;
+    }
 }
 
 /*
@@ -56,16 +116,30 @@ CanHandler::CanHandler(CanBusNode canBusNode)
  */
 void CanHandler::setup()
 {
+    windowStart = Clock::millis();
+    if (bus == NULL) { // internal bus, no hardware to initialize
+        Logger::info("CAN%d (internal) init ok", canBusNode);
+        return;
+    }
+
     // Initialize the canbus at the specified baudrate
     bus->init(canBusNode == CAN_BUS_EV ? CFG_CAN0_SPEED : CFG_CAN1_SPEED);
-    bus->setNumTXBoxes(canBusNode == CAN_BUS_EV ? CFG_CAN0_NUM_TX_MAILBOXES : CFG_CAN1_NUM_TX_MAILBOXES);
-    Logger::info("CAN%d init ok", (canBusNode == CAN_BUS_EV ? 0 : 1));
+    numRxMailboxes = CFG_CAN_NUM_MAILBOXES - (canBusNode == CAN_BUS_EV ? CFG_CAN0_NUM_TX_MAILBOXES : CFG_CAN1_NUM_TX_MAILBOXES);
+    bus->setNumTXBoxes(CFG_CAN_NUM_MAILBOXES - numRxMailboxes);
+    // receive all frames directly in the CAN interrupt instead of the library's buffer
+    bus->setGeneralCallback(canBusNode == CAN_BUS_EV ? canEvReceiveInterrupt : canCarReceiveInterrupt);
+    for (int mailbox = 0; mailbox < numRxMailboxes; mailbox++) { // disable all rx mailboxes until they get a filter
+        bus->mailbox_set_mode(mailbox, CAN_MB_DISABLE_MODE);
+    }
+    filterCount = 0;
+    updateFilters();
+    Logger::info("CAN%d init ok", canBusNode);
 }
 
 /*
  * Attach a CanObserver. Can frames which match the id/mask will be forwarded to the observer
  * via the method handleCanFrame(RX_CAN_FRAME).
- * Sets up a can bus mailbox if necessary.
+ * The filters of the rx mailboxes are re-calculated to cover the new subscription.
  *
  *  \param observer - the observer object to register (must implement CanObserver class)
  *  \param id - the id of the can frame to listen to
@@ -79,29 +153,21 @@ void CanHandler::attach(CanObserver* observer, uint32_t id, uint32_t mask, bool
         return;
     }
 
-    int8_t pos = findFreeObserverData();
+    int16_t pos = findFreeObserverData();
 
     if (pos == -1) {
         Logger::error("no free space in CanHandler::observerData, increase its size via CFG_CAN_NUM_OBSERVERS");
         return;
     }
 
-    int mailbox = bus->findFreeRXMailbox();
-
-    if (mailbox == -1) {
-        Logger::error("no free CAN mailbox on bus %d", canBusNode);
-        return;
-    }
-
     observerData[pos].id = id;
     observerData[pos].mask = mask;
     observerData[pos].extended = extended;
-    observerData[pos].mailbox = mailbox;
     observerData[pos].observer = observer;
+    rebuildIndex();
+    updateFilters();
 
-    bus->setRXFilter((uint8_t) mailbox, id, mask, extended);
-
-    Logger::debug("attached CanObserver (%#x) for id=%#x, mask=%#x, mailbox=%d", observer, id, mask, mailbox);
+    Logger::debug("attached CanObserver (%#x) for id=%#x, mask=%#x", observer, id, mask);
 }
 
 /*
@@ -125,6 +191,7 @@ bool CanHandler::isAttached(CanObserver* observer, uint32_t id, uint32_t mask)
 
 /*
  * Detaches a previously attached observer from this handler.
+ * Mailboxes which are no longer required are released.
  *
  * \param observer - observer object to detach
  * \param id - id of the observer to detach (required as one CanObserver may register itself several times)
@@ -137,8 +204,8 @@ void CanHandler::detach(CanObserver* observer, uint32_t id, uint32_t mask)
                 observerData[i].id == id &&
                 observerData[i].mask == mask) {
             observerData[i].observer = NULL;
-
-            //TODO: if no more observers on same mailbox, disable its interrupt, reset mailbox
+            rebuildIndex();
+            updateFilters();
         }
     }
 }
@@ -158,12 +225,225 @@ void CanHandler::logFrame(CAN_FRAME& frame)
     }
 }
 
+/*
+ * Check if a mask selects exactly one id (all bits of a standard or extended id are set).
+ */
+bool CanHandler::isExactMask(uint32_t mask, bool extended)
+{
+    return (mask & 0x1fffffff) == (extended ? 0x1fffffff : 0x7ff);
+}
+
+/*
+ * Calculate the position of an id in the exactIndex hash table.
+ * Standard and extended frames with the same id number are different keys.
+ */
+uint8_t CanHandler::hashId(uint32_t id, bool extended)
+{
+    if (extended) {
+        id |= 0x80000000;
+    }
+    return (id ^ (id >> 7) ^ (id >> 14) ^ (id >> 21)) & (CFG_CAN_ID_HASH_SIZE - 1);
+}
+
+/*
+ * Look up the first observerData entry which subscribed exactly to the given id and frame type.
+ *
+ * \retval array index into observerData[] or -1 if nobody subscribed to the id
+ */
+int16_t CanHandler::findExact(uint32_t id, bool extended)
+{
+    uint8_t pos = hashId(id, extended);
+
+    for (uint16_t count = 0; count < CFG_CAN_ID_HASH_SIZE; pos = (pos + 1) & (CFG_CAN_ID_HASH_SIZE - 1), count++) {
+        int16_t entry = exactIndex[pos];
+
+        if (entry == -1 || (observerData[entry].id == id && observerData[entry].extended == extended)) {
+            return entry;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Re-build the dispatch index after the subscriptions changed.
+ * Subscriptions to exactly one id are stored in a hash table (entries with the same id
+ * and frame type are chained), all others are kept in a list which is checked with id/mask for every frame.
+ */
+void CanHandler::rebuildIndex()
+{
+    for (int i = 0; i < CFG_CAN_ID_HASH_SIZE; i++) {
+        exactIndex[i] = -1;
+    }
+    maskedCount = 0;
+
+    for (int i = CFG_CAN_NUM_OBSERVERS - 1; i >= 0; i--) { // backwards, so the chains are in order of the entries
+        CanObserverData *data = &observerData[i];
+
+        data->next = -1;
+        if (data->observer == NULL) {
+            continue;
+        }
+        if (!isExactMask(data->mask, data->extended)) {
+            continue;
+        }
+
+        uint8_t pos = hashId(data->id, data->extended);
+        while (exactIndex[pos] != -1
+                && (observerData[exactIndex[pos]].id != data->id || observerData[exactIndex[pos]].extended != data->extended)) {
+            pos = (pos + 1) & (CFG_CAN_ID_HASH_SIZE - 1);
+        }
+        data->next = exactIndex[pos];
+        exactIndex[pos] = i;
+    }
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer != NULL && !isExactMask(observerData[i].mask, observerData[i].extended)) {
+            maskedIndex[maskedCount++] = i;
+        }
+    }
+}
+
+/*
+ * Check if all frames accepted by a filter are also accepted by another filter.
+ */
+bool CanHandler::isCovered(CanFilter *filter, CanFilter *by)
+{
+    return filter->extended == by->extended && (filter->mask & by->mask) == by->mask && (filter->id & by->mask) == (by->id & by->mask);
+}
+
+/*
+ * Calculate a minimal set of mailbox filters which accepts all subscribed frames.
+ * Duplicate and covered subscriptions are removed. If more filters than rx mailboxes
+ * remain, the pair of filters (of the same frame type) which can be merged with the
+ * least relevant bits lost is merged until the filters fit. Frames which pass a merged
+ * filter without being subscribed are dropped by the software filter in dispatch().
+ * If the filters can't be merged any further, one open mailbox per frame type is used
+ * and all filtering is done in software.
+ *
+ * The frames of the routes are received like subscribed frames.
+ *
+ * \param filters - array of at least CFG_CAN_NUM_OBSERVERS + CFG_CAN_NUM_ROUTES entries which receives the filters
+ * \retval the number of filters
+ */
+uint8_t CanHandler::calculateFilters(CanFilter *filters)
+{
+    uint8_t count = 0;
+
+    if (promiscuous) {
+        return openFilters(filters);
+    }
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer != NULL) {
+            CanFilter *filter = &filters[count++];
+            filter->extended = observerData[i].extended;
+            filter->mask = observerData[i].mask & (filter->extended ? 0x1fffffff : 0x7ff);
+            filter->id = observerData[i].id & filter->mask;
+        }
+    }
+    for (int i = 0; i < routeCount; i++) {
+        CanFilter *filter = &filters[count++];
+        filter->extended = routes[i].extended;
+        filter->mask = routes[i].mask;
+        filter->id = routes[i].id;
+    }
+
+    while (true) {
+        // drop filters which are covered by another one (of two identical filters the later is dropped)
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j < count; j++) {
+                if (i != j && isCovered(&filters[i], &filters[j]) && (!isCovered(&filters[j], &filters[i]) || i > j)) {
+                    filters[i--] = filters[--count];
+                    break;
+                }
+            }
+        }
+
+        if (count <= numRxMailboxes) {
+            break;
+        }
+
+        int bestA = -1, bestB = -1, bestBits = -1;
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                if (filters[i].extended == filters[j].extended) {
+                    int bits = __builtin_popcount(filters[i].mask & filters[j].mask & ~(filters[i].id ^ filters[j].id));
+                    if (bits > bestBits) {
+                        bestBits = bits;
+                        bestA = i;
+                        bestB = j;
+                    }
+                }
+            }
+        }
+        if (bestA == -1) {
+            Logger::warn("CAN%d: not enough rx mailboxes, accepting all frames", canBusNode);
+            return openFilters(filters);
+        }
+        filters[bestA].mask &= filters[bestB].mask & ~(filters[bestA].id ^ filters[bestB].id);
+        filters[bestA].id &= filters[bestA].mask;
+        filters[bestB] = filters[--count];
+    }
+    return count;
+}
+
+/*
+ * Set up one filter for all standard and one for all extended frames.
+ *
+ * \param filters - array of at least 2 entries which receives the filters
+ * \retval the number of filters
+ */
+uint8_t CanHandler::openFilters(CanFilter *filters)
+{
+    filters[0].id = filters[0].mask = 0;
+    filters[0].extended = false;
+    filters[1].id = filters[1].mask = 0;
+    filters[1].extended = true;
+    if (numRxMailboxes < 2) {
+        Logger::error("CAN%d: not enough rx mailboxes for standard and extended frames", canBusNode);
+        return numRxMailboxes;
+    }
+    return 2;
+}
+
+/*
+ * Re-calculate the mailbox filters and re-program the rx mailboxes which changed.
+ * Unused mailboxes are disabled.
+ */
+void CanHandler::updateFilters()
+{
+    CanFilter filters[CFG_CAN_NUM_OBSERVERS + CFG_CAN_NUM_ROUTES];
+
+    if (numRxMailboxes == 0) { // not set up yet, the filters are programmed in setup()
+        return;
+    }
+
+    uint8_t count = calculateFilters(filters);
+
+    for (int mailbox = 0; mailbox < numRxMailboxes; mailbox++) {
+        if (mailbox < count) {
+            if (mailbox < filterCount && filter[mailbox].id == filters[mailbox].id && filter[mailbox].mask == filters[mailbox].mask
+                    && filter[mailbox].extended == filters[mailbox].extended) {
+                continue;
+            }
+            filter[mailbox] = filters[mailbox];
+            bus->mailbox_set_mode(mailbox, CAN_MB_RX_MODE);
+            bus->setRXFilter(mailbox, filters[mailbox].id, filters[mailbox].mask, filters[mailbox].extended);
+            Logger::debug("CAN%d mailbox %d: id=%#x, mask=%#x, extended=%d", canBusNode, mailbox, filters[mailbox].id,
+                    filters[mailbox].mask, filters[mailbox].extended);
+        } else if (mailbox < filterCount) {
+            bus->mailbox_set_mode(mailbox, CAN_MB_DISABLE_MODE);
+        }
+    }
+    filterCount = count;
+}
+
 /*
  * Find a observerData entry which is not in use.
  *
  * \retval array index of the next unused entry in observerData[]
  */
-int8_t CanHandler::findFreeObserverData()
+int16_t CanHandler::findFreeObserverData()
 {
     for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
         if (observerData[i].observer == NULL) {
@@ -175,27 +455,442 @@ int8_t CanHandler::findFreeObserverData()
 }
 
 /*
- * If a message is available, read it and forward it to registered observers.
+ * Called in the CAN interrupt for every received frame. The frame is routed to
+ * other buses and copied together with a timestamp to the receive buffer. If the
+ * buffer is full, the frame is dropped and counted as overrun (it still counts to
+ * the bus load and is still routed).
+ * Everything is done in a critical section, as the timer interrupt (cyclic frames)
+ * or the interrupt of the other bus may preempt the CAN interrupt and use the same
+ * tx queues and counters.
+ */
+void CanHandler::handleReceive(CAN_FRAME *frame)
+{
+    uint32_t primask = enterCritical();
+    uint16_t bits = frameBits(frame);
+
+    rxFrames++;
+    rxBits += bits;
+    windowBits += bits;
+    if (canCapture.isRecording()) {
+        canCapture.record(canBusNode, frame, false);
+    }
+    if (canGateway.isActive()) {
+        canGateway.forward(canBusNode, frame);
+    }
+    if (routeCount > 0) {
+        route(frame);
+    }
+
+    if (!queueReceived(frame)) {
+        overrunCount++;
+    }
+    leaveCritical(primask);
+}
+
+/*
+ * Copy a frame together with a timestamp to the receive buffer.
+ * Must be called with interrupts disabled.
+ *
+ * \retval false if the receive buffer is full
+ */
+bool CanHandler::queueReceived(CAN_FRAME *frame)
+{
+    uint16_t head = rxHead;
+    uint16_t next = (head + 1) % CFG_CAN_RX_BUFFER_SIZE;
+
+    if (next == rxTail) {
+        return false;
+    }
+    rxBuffer[head].frame = *frame;
+    rxBuffer[head].timestamp = Clock::micros();
+    rxHead = next;
+    return true;
+}
+
+/*
+ * Add a route which forwards received frames to another bus.
+ *
+ * \param destination - the bus to which the frames are sent
+ * \param id - the id of the frames to forward
+ * \param mask - the bits of the id which have to match
+ * \param extended - route extended frames
+ * \param interval - minimum time between two forwarded frames of the route in ms (0 = no limit),
+ *                   frames received within the interval are dropped
+ * \param targetId - id on the destination bus (the bits selected by mask are replaced), CAN_ROUTE_SAME_ID to keep the id
+ * \retval false if the route is invalid or no space is left
+ */
+bool CanHandler::addRoute(CanHandler *destination, uint32_t id, uint32_t mask, bool extended, uint32_t interval, uint32_t targetId)
+{
+    if (destination == this) {
+        Logger::error("CAN%d: a route must not lead back to the same bus", canBusNode);
+        return false;
+    }
+    if (routeCount >= CFG_CAN_NUM_ROUTES) {
+        Logger::error("CAN%d: no free route, increase CFG_CAN_NUM_ROUTES", canBusNode);
+        return false;
+    }
+
+    CanRoute *route = &routes[routeCount];
+    route->extended = extended;
+    route->mask = mask & (extended ? 0x1fffffff : 0x7ff);
+    route->id = id & route->mask;
+    route->targetId = (targetId == CAN_ROUTE_SAME_ID ? id : targetId) & route->mask;
+    route->destination = destination;
+    route->interval = interval;
+    route->lastForward = Clock::millis() - interval;
+    route->forwarded = route->dropped = 0;
+
+    noInterrupts();
+    routeCount++;
+    interrupts();
+    updateFilters();
+
+    Logger::info("CAN%d: route id=%#x, mask=%#x to CAN%d id=%#x, interval %dms", canBusNode, route->id, route->mask,
+            destination->canBusNode, route->targetId, interval);
+    return true;
+}
+
+/*
+ * Remove all routes of this bus.
+ */
+void CanHandler::clearRoutes()
+{
+    noInterrupts();
+    routeCount = 0;
+    interrupts();
+    updateFilters();
+}
+
+/*
+ * Forward a received frame to the destination of all matching routes.
+ * Must be called within a critical section (see handleReceive()). The frames are
+ * only queued, they are handed to the mailboxes of the destination with its next
+ * process() or sendFrame().
+ */
+void CanHandler::route(CAN_FRAME *frame)
+{
+    for (int i = 0; i < routeCount; i++) {
+        CanRoute *route = &routes[i];
+
+        if (route->extended != frame->extended || (frame->id & route->mask) != route->id) {
+            continue;
+        }
+
+        uint32_t now = Clock::millis();
+        if (now - route->lastForward < route->interval) {
+            route->dropped++;
+            continue;
+        }
+
+        CAN_FRAME routed = *frame;
+        routed.id = (frame->id & ~route->mask) | route->targetId;
+        if (route->destination->enqueue(routed, TX_PRIORITY_CONTROL, true, true)) {
+            route->lastForward = now;
+            route->forwarded++;
+        } else {
+            route->dropped++;
+        }
+    }
+}
+
+/*
+ * Put a frame into the receive buffer as if it was received from the bus
+ * (e.g. to replay a recorded trace). It is dispatched to the observers in the
+ * next process(), but it is not captured, forwarded by the gateway or routed
+ * and doesn't count to the bus load.
+ *
+ * \retval false if the receive buffer is full
+ */
+bool CanHandler::injectFrame(CAN_FRAME *frame)
+{
+    uint32_t primask = enterCritical();
+    bool queued = queueReceived(frame);
+    leaveCritical(primask);
+    return queued;
+}
+
+/*
+ * Open the mailbox filters to receive all frames on the bus (e.g. for the
+ * gateway mode) or return to the filters which cover the subscriptions.
+ * The observers still only get the frames they subscribed to.
+ */
+void CanHandler::setPromiscuous(bool promiscuous)
+{
+    this->promiscuous = promiscuous;
+    updateFilters();
+}
+
+/*
+ * Forward all frames in the receive buffer to the registered observers.
+ * If CFG_CAN_PROCESS_BUDGET is set, the processing stops after the budget
+ * (microseconds) is used up (but at least one frame is processed), the
+ * rest remains buffered for the next loop.
  */
 void CanHandler::process()
 {
-    static CAN_FRAME frame;
+    uint32_t start = Clock::wallMicros();
 
-    if (bus->rx_avail()) {
-        bus->get_rx_buff(frame);
-//      logFrame(frame);
+    while (rxTail != rxHead) {
+        dispatch(&rxBuffer[rxTail]);
+        rxTail = (rxTail + 1) % CFG_CAN_RX_BUFFER_SIZE;
 
-        for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
-            if (observerData[i].observer != NULL) {
-                // Apply mask to frame.id and observer.id. If they match, forward the frame to the observer
-                if ((frame.id & observerData[i].mask) == (observerData[i].id & observerData[i].mask)) {
-                    observerData[i].observer->handleCanFrame(&frame);
-                }
-            }
+#if CFG_CAN_PROCESS_BUDGET > 0
+        if (Clock::wallMicros() - start > CFG_CAN_PROCESS_BUDGET) {
+            break;
         }
+#endif
+    }
+
+    transmit();
+    updateLoad();
+    checkErrorState();
+
+    uint32_t overruns = overrunCount;
+    if (overruns != reportedOverrunCount) {
+        Logger::warn("CAN%d receive buffer overrun, %d frames lost", canBusNode, overruns - reportedOverrunCount);
+        reportedOverrunCount = overruns;
     }
 }
 
+/*
+ * Forward a received frame to all observers which subscribed to its id.
+ * The observers of the exact id are looked up in the hash table, only the
+ * subscriptions with a mask have to be compared one by one.
+ * An observer might detach itself in handleCanFrame(), so the entries are
+ * checked before every call.
+ */
+void CanHandler::dispatch(CanRxEntry *entry)
+{
+    CAN_FRAME *frame = &entry->frame;
+
+    receiveTime = entry->timestamp;
+//  logFrame(*frame);
+
+    // the hardware filters may pass frames of the other type (merged or open mailboxes, promiscuous mode)
+    for (int16_t i = findExact(frame->id, frame->extended); i != -1; i = observerData[i].next) {
+        if (observerData[i].observer != NULL) {
+            observerData[i].observer->handleCanFrame(frame);
+        }
+    }
+
+    for (int i = 0; i < maskedCount; i++) {
+        CanObserverData *data = &observerData[maskedIndex[i]];
+
+        // Apply mask to frame.id and observer.id. If they match, forward the frame to the observer
+        if (data->observer != NULL && data->extended == frame->extended && (frame->id & data->mask) == (data->id & data->mask)) {
+            data->observer->handleCanFrame(frame);
+        }
+    }
+}
+
+/*
+ * Check if no received frame is waiting to be processed and no frame is waiting to be sent.
+ */
+bool CanHandler::isIdle()
+{
+    return rxHead == rxTail && txDepth == 0;
+}
+
+/*
+ * Get the time (Clock::micros()) at which the frame which is currently
+ * dispatched was received. Only valid during handleCanFrame().
+ */
+uint32_t CanHandler::getReceiveTime()
+{
+    return receiveTime;
+}
+
+/*
+ * Get the number of frames which were lost because the receive buffer was full.
+ */
+uint32_t CanHandler::getOverrunCount()
+{
+    return overrunCount;
+}
+
+/*
+ * Get the bus load in 0.1% averaged over the last CFG_CAN_LOAD_WINDOWS windows.
+ * Only frames which were accepted by the rx mailboxes and frames sent by
+ * this node are seen, frames filtered out by the hardware are not included.
+ */
+uint16_t CanHandler::getLoad()
+{
+    return load;
+}
+
+/*
+ * Get the highest bus load of a single window in 0.1% since the statistics were reset.
+ */
+uint16_t CanHandler::getPeakLoad()
+{
+    return peakLoad;
+}
+
+/*
+ * Get the number of times the CAN controller went bus-off since the statistics were reset.
+ */
+uint16_t CanHandler::getBusOffCount()
+{
+    return busOffCount;
+}
+
+/*
+ * Get the number of frames which were handed to a tx mailbox since the statistics were reset.
+ */
+uint32_t CanHandler::getTxSentCount()
+{
+    return txSent;
+}
+
+/*
+ * Get the number of queued frames which were superseded by a newer frame with the same id
+ * since the statistics were reset.
+ */
+uint32_t CanHandler::getTxReplacedCount()
+{
+    return txReplaced;
+}
+
+/*
+ * Get the number of frames which were dropped because the tx queue was full since
+ * the statistics were reset.
+ */
+uint32_t CanHandler::getTxDroppedCount()
+{
+    return txDropped;
+}
+
+/*
+ * Calculate the number of bits a frame occupies on the bus including the
+ * worst case number of stuff bits and the inter-frame space.
+ * Of a standard frame 34 bits plus the data are subject to bit stuffing (one
+ * stuff bit per 4 bits in the worst case), of an extended frame 54 bits. 13 bits
+ * (CRC delimiter, ack, end of frame, inter-frame space) are never stuffed.
+ */
+uint16_t CanHandler::frameBits(CAN_FRAME *frame)
+{
+    uint8_t length = (frame->rtr ? 0 : min(frame->length, 8));
+    uint16_t stuffed = (frame->extended ? 54 : 34) + 8 * length;
+
+    return stuffed + 13 + (stuffed - 1) / 4;
+}
+
+/*
+ * Close the current load window when CFG_CAN_LOAD_WINDOW ms have passed and
+ * re-calculate the average load of the last CFG_CAN_LOAD_WINDOWS windows.
+ * The effective duration of each window is used, so a late call of process()
+ * does not distort the result.
+ */
+void CanHandler::updateLoad()
+{
+    uint32_t now = Clock::millis();
+    uint32_t elapsed = now - windowStart;
+
+    if (elapsed < CFG_CAN_LOAD_WINDOW) {
+        return;
+    }
+    windowStart = now;
+
+    noInterrupts();
+    uint32_t bits = windowBits;
+    windowBits = 0;
+    interrupts();
+
+    loadBits[loadIndex] = bits;
+    loadTime[loadIndex] = min(elapsed, 0xffff);
+    loadIndex = (loadIndex + 1) % CFG_CAN_LOAD_WINDOWS;
+
+    uint16_t windowLoad = calculateLoad(bits, elapsed);
+    if (windowLoad > peakLoad) {
+        peakLoad = windowLoad;
+    }
+
+    uint32_t sumBits = 0, sumTime = 0;
+    for (int i = 0; i < CFG_CAN_LOAD_WINDOWS; i++) {
+        sumBits += loadBits[i];
+        sumTime += loadTime[i];
+    }
+    load = calculateLoad(sumBits, sumTime);
+
+#ifdef CFG_CAN_DIAGNOSTIC_FRAME
+    if (loadIndex == 0) {
+        sendDiagnostic();
+    }
+#endif
+}
+
+/*
+ * Calculate the bus load in 0.1% from the number of bits transferred in a time (ms).
+ * As the bits are a worst case estimation, the result is limited to 100%.
+ */
+uint16_t CanHandler::calculateLoad(uint32_t bits, uint32_t time)
+{
+    if (time == 0) {
+        return 0;
+    }
+    return min((uint64_t) bits * 1000000 / ((uint64_t) bitRate * time), 1000);
+}
+
+/*
+ * Read the error counters and the error state of the CAN controller and report
+ * when the controller enters the error passive or bus-off state.
+ */
+void CanHandler::checkErrorState()
+{
+    if (numRxMailboxes == 0) { // not set up yet or internal bus
+        return;
+    }
+
+    uint32_t status = bus->get_status();
+    uint8_t rxErrors = bus->get_rx_error_cnt();
+    uint8_t txErrors = bus->get_tx_error_cnt();
+
+    if (rxErrors > rxErrorMax) {
+        rxErrorMax = rxErrors;
+    }
+    if (txErrors > txErrorMax) {
+        txErrorMax = txErrors;
+    }
+
+    if ((status & CAN_SR_BOFF) && !(lastStatus & CAN_SR_BOFF)) {
+        busOffCount++;
+        Logger::error("CAN%d bus off", canBusNode);
+    } else if (!(status & CAN_SR_BOFF) && (lastStatus & CAN_SR_BOFF)) {
+        Logger::info("CAN%d recovered from bus off", canBusNode);
+    } else if ((status & CAN_SR_ERRP) && !(lastStatus & CAN_SR_ERRP)) {
+        Logger::warn("CAN%d error passive (rx errors: %d, tx errors: %d)", canBusNode, rxErrors, txErrors);
+    }
+    lastStatus = status;
+}
+
+/*
+ * Send the load and error counters of this bus to GEVCU (always on the EV bus).
+ *
+ * byte 0: bus (0 = EV, 1 = car, 2 = internal)
+ * byte 1: load in %
+ * byte 2: peak load in %
+ * byte 3: rx error counter
+ * byte 4: tx error counter
+ * byte 5: bus-off events
+ * byte 6: tx queue high-water mark
+ * byte 7: lost frames (rx overrun and tx queue full)
+ */
+void CanHandler::sendDiagnostic()
+{
+    CAN_FRAME frame;
+
+    prepareOutputFrame(&frame, CAN_ID_GEVCU_EXT_CAN_DIAGNOSTIC);
+    frame.data.byte[0] = canBusNode;
+    frame.data.byte[1] = load / 10;
+    frame.data.byte[2] = peakLoad / 10;
+    frame.data.byte[3] = (bus == NULL ? 0 : min(bus->get_rx_error_cnt(), 255));
+    frame.data.byte[4] = (bus == NULL ? 0 : min(bus->get_tx_error_cnt(), 255));
+    frame.data.byte[5] = min(busOffCount, 255);
+    frame.data.byte[6] = txHighWater;
+    frame.data.byte[7] = min(overrunCount + txDropped, 255);
+    canHandlerEv.sendFrame(frame, TX_PRIORITY_TELEMETRY);
+}
+
 /*
  * Prepare the CAN transmit frame.
  * Re-sets all parameters in the re-used frame.
@@ -209,11 +904,195 @@ void CanHandler::prepareOutputFrame(CAN_FRAME *frame, uint32_t id)
     frame->data.value = 0;
 }
 
-//Allow the canbus driver to figure out the proper mailbox to use
-//(whatever happens to be open) or queue it to send (if nothing is open)
-void CanHandler::sendFrame(CAN_FRAME& frame)
+/*
+ * Queue a frame for transmission. Frames of a higher priority are always handed to
+ * the tx mailboxes first, frames of the same priority in the order they were queued.
+ * If replace is set and a frame with the same id is still waiting in the queue of the
+ * priority, its content is replaced by the new frame (it keeps its position), so no
+ * stale values pile up on a slow bus. Don't use replace for different frames which
+ * share the same id.
+ * If the queue is full, the frame is dropped and counted.
+ *
+ * May also be called from interrupt context or within a critical section.
+ *
+ * \retval false if the frame was dropped
+ */
+bool CanHandler::sendFrame(CAN_FRAME& frame, TxPriority priority, bool replace)
+{
+    uint32_t primask = enterCritical();
+    bool queued = enqueue(frame, priority, replace);
+    leaveCritical(primask);
+
+    transmit();
+    return queued;
+}
+
+/*
+ * Put a frame into the tx queue of the priority or replace a queued frame (see sendFrame()).
+ * Routed frames only replace routed frames and frames of devices only those of devices,
+ * so a route can't overwrite a frame of a device with the same id and vice versa.
+ * Must be called with interrupts disabled.
+ */
+bool CanHandler::enqueue(CAN_FRAME& frame, TxPriority priority, bool replace, bool routed)
+{
+    if (replace) {
+        for (uint8_t i = txTail[priority]; i != txHead[priority]; i = (i + 1) % CFG_CAN_TX_QUEUE_SIZE) {
+            CAN_FRAME *queued = &txQueue[priority][i].frame;
+            if (queued->id == frame.id && queued->extended == frame.extended && txQueue[priority][i].routed == routed) {
+                *queued = frame;
+                txReplaced++;
+                return true;
+            }
+        }
+    }
+
+    uint8_t head = txHead[priority];
+    uint8_t next = (head + 1) % CFG_CAN_TX_QUEUE_SIZE;
+    if (next == txTail[priority]) {
+        txDropped++;
+        return false;
+    }
+    txQueue[priority][head].frame = frame;
+    txQueue[priority][head].timestamp = Clock::micros();
+    txQueue[priority][head].routed = routed;
+    txHead[priority] = next;
+    if (++txDepth > txHighWater) {
+        txHighWater = txDepth;
+    }
+    return true;
+}
+
+/*
+ * Check if a frame of the priority can be queued without being dropped.
+ * Useful for senders of bursts (e.g. ISO-TP) which can wait.
+ */
+bool CanHandler::hasTxQueueSpace(TxPriority priority)
+{
+    return (txHead[priority] + 1) % CFG_CAN_TX_QUEUE_SIZE != txTail[priority];
+}
+
+/*
+ * Check if one of the tx mailboxes is ready to take a frame.
+ * On the internal bus the receive buffer takes the place of the mailboxes.
+ */
+bool CanHandler::isTxMailboxFree()
+{
+    if (bus == NULL) {
+        return (rxHead + 1) % CFG_CAN_RX_BUFFER_SIZE != rxTail;
+    }
+    for (int mailbox = numRxMailboxes; mailbox < CFG_CAN_NUM_MAILBOXES; mailbox++) {
+        if (bus->mailbox_get_status(mailbox) & CAN_MSR_MRDY) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Hand queued frames to the tx mailboxes as long as mailboxes are free, highest priority first.
+ * The frames are only passed to the driver when a mailbox is free, so they
+ * can't queue up in the driver's buffer where the priorities would be lost.
+ */
+void CanHandler::transmit()
+{
+    if (numRxMailboxes == 0 && bus != NULL) { // not set up yet
+        return;
+    }
+
+    uint32_t primask = enterCritical();
+    while (txDepth > 0 && isTxMailboxFree()) {
+        int priority = 0;
+        while (txHead[priority] == txTail[priority]) {
+            priority++;
+        }
+
+        CanTxEntry *entry = &txQueue[priority][txTail[priority]];
+        if (bus == NULL) { // loop back, counted, captured and forwarded as received frame
+            handleReceive(&entry->frame);
+        } else {
+            bus->sendFrame(entry->frame);
+            if (canCapture.isRecording()) {
+                canCapture.record(canBusNode, &entry->frame, true);
+            }
+            if (canGateway.isActive()) {
+                canGateway.forward(canBusNode, &entry->frame);
+            }
+            uint16_t bits = frameBits(&entry->frame);
+            txBits += bits;
+            windowBits += bits;
+        }
+        txTail[priority] = (txTail[priority] + 1) % CFG_CAN_TX_QUEUE_SIZE;
+        txDepth--;
+
+        uint32_t latency = Clock::micros() - entry->timestamp;
+        txSent++;
+        txLatencySum += latency;
+        if (latency < txLatencyMin) {
+            txLatencyMin = latency;
+        }
+        if (latency > txLatencyMax) {
+            txLatencyMax = latency;
+        }
+    }
+    leaveCritical(primask);
+}
+
+/*
+ * Print the load, error and transmit statistics of the bus.
+ */
+void CanHandler::printStatistics()
+{
+    Logger::console("CAN%d load: %d.%d%% (peak %d.%d%%), rx: %d frames / %d bits, tx: %d bits, errors: rx %d (max %d) tx %d (max %d), bus-off: %d",
+            canBusNode, load / 10, load % 10, peakLoad / 10, peakLoad % 10, rxFrames, rxBits, txBits,
+            (bus == NULL ? 0 : bus->get_rx_error_cnt()), rxErrorMax, (bus == NULL ? 0 : bus->get_tx_error_cnt()), txErrorMax, busOffCount);
+    Logger::console("CAN%d tx: %d sent, %d replaced, %d dropped, queue %d (max %d), latency %d/%d/%dus", canBusNode,
+            txSent, txReplaced, txDropped, txDepth, txHighWater, (txSent == 0 ? 0 : txLatencyMin),
+            (uint32_t) (txSent == 0 ? 0 : txLatencySum / txSent), txLatencyMax);
+    for (int i = 0; i < routeCount; i++) {
+        CanRoute *route = &routes[i];
+        Logger::console("CAN%d route %d: id=%#x, mask=%#x -> CAN%d id=%#x, interval %dms: %d forwarded, %d dropped", canBusNode, i,
+                route->id, route->mask, route->destination->canBusNode, route->targetId, route->interval, route->forwarded, route->dropped);
+    }
+}
+
+/*
+ * Reset the load, error and transmit statistics.
+ */
+void CanHandler::resetStatistics()
+{
+    noInterrupts();
+    rxFrames = rxBits = 0;
+    interrupts();
+    txBits = 0;
+    peakLoad = 0;
+    rxErrorMax = txErrorMax = 0;
+    busOffCount = 0;
+    txHighWater = txDepth;
+    txSent = txReplaced = txDropped = 0;
+    txLatencyMin = 0xffffffff;
+    txLatencyMax = 0;
+    txLatencySum = 0;
+    noInterrupts();
+    for (int i = 0; i < routeCount; i++) {
+        routes[i].forwarded = routes[i].dropped = 0;
+    }
+    interrupts();
+}
+
+/*
+ * Interrupt function for frames received on CAN0
+ */
+void canEvReceiveInterrupt(CAN_FRAME *frame)
+{
+    canHandlerEv.handleReceive(frame);
+}
+
+/*
+ * Interrupt function for frames received on CAN1
+ */
+void canCarReceiveInterrupt(CAN_FRAME *frame)
 {
-    bus->sendFrame(frame);
+    canHandlerCar.handleReceive(frame);
 }
 
 /*
@@ -33,6 +33,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "variant.h"
 #include <DueTimer.h>
 #include "Logger.h"
+#include "Clock.h"
+#include "CriticalSection.h"
+
+#define CAN_ID_GEVCU_EXT_CAN_DIAGNOSTIC 0x72b // bus load and error counters of a CAN bus (see CFG_CAN_DIAGNOSTIC_FRAME)
+#define CAN_ROUTE_SAME_ID 0xffffffff // forward a frame without changing its id
 
 class CanObserver
 {
@@ -45,18 +50,43 @@ class CanHandler
 public:
     enum CanBusNode {
         CAN_BUS_EV, // CAN0 is intended to be connected to the EV bus (controller, charger, etc.)
-        CAN_BUS_CAR // CAN1 is intended to be connected to the car's high speed bus (the one with the ECU)
+        CAN_BUS_CAR, // CAN1 is intended to be connected to the car's high speed bus (the one with the ECU)
+        CAN_BUS_INTERNAL // virtual bus between the devices, sent frames are received by this node itself
+    };
+    enum TxPriority {
+        TX_PRIORITY_SAFETY, // safety relevant frames, always sent first
+        TX_PRIORITY_CONTROL, // control of actuators
+        TX_PRIORITY_TELEMETRY, // measurement values and status reports
+        NUM_TX_PRIORITIES
     };
 
     CanHandler(CanBusNode busNumber);
+    static CanHandler *getHandler(uint8_t busNumber);
     void setup();
     void attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended);
     bool isAttached(CanObserver* observer, uint32_t id, uint32_t mask);
     void detach(CanObserver *observer, uint32_t id, uint32_t mask);
     void process();
+    bool isIdle();
+    void handleReceive(CAN_FRAME *frame); // must be public when called from the non-class functions
+    uint32_t getReceiveTime();
+    uint32_t getOverrunCount();
+    uint16_t getLoad();
+    uint16_t getPeakLoad();
+    uint16_t getBusOffCount();
+    uint32_t getTxSentCount();
+    uint32_t getTxReplacedCount();
+    uint32_t getTxDroppedCount();
     void prepareOutputFrame(CAN_FRAME *frame, uint32_t id);
-    void sendFrame(CAN_FRAME& frame);
+    bool sendFrame(CAN_FRAME& frame, TxPriority priority = TX_PRIORITY_CONTROL, bool replace = false);
+    bool hasTxQueueSpace(TxPriority priority);
+    bool injectFrame(CAN_FRAME *frame);
+    void setPromiscuous(bool promiscuous);
+    bool addRoute(CanHandler *destination, uint32_t id, uint32_t mask, bool extended, uint32_t interval = 0, uint32_t targetId = CAN_ROUTE_SAME_ID);
+    void clearRoutes();
     void logFrame(CAN_FRAME& frame);
+    void printStatistics();
+    void resetStatistics();
 protected:
 
 private:
@@ -64,18 +94,101 @@ private:
         uint32_t id;    // what id to listen to
         uint32_t mask;  // the CAN frame mask to listen to
         bool extended;  // are extended frames expected
-        uint8_t mailbox;    // which mailbox is this observer assigned to
+        int16_t next;    // next entry with the same exact id (index into observerData, -1 = none)
         CanObserver *observer;  // the observer object (e.g. a device)
     };
 
+    struct CanFilter {
+        uint32_t id; // the id to accept (only the bits set in mask are relevant)
+        uint32_t mask; // the bits which have to match
+        bool extended; // filter for extended frames
+    };
+    struct CanRoute {
+        uint32_t id; // the id's to forward (only the bits set in mask are relevant)
+        uint32_t mask; // the bits which have to match
+        bool extended; // route extended frames
+        uint32_t targetId; // the bits selected by mask are replaced by these bits on the destination bus
+        CanHandler *destination; // the bus the frames are sent to
+        uint32_t interval; // minimum time between two forwarded frames in ms (0 = no limit)
+        uint32_t lastForward; // Clock::millis() when the last frame was forwarded
+        volatile uint32_t forwarded, dropped; // frames sent to the destination / dropped by the rate limit or a full tx queue
+    };
+    struct CanTxEntry {
+        CAN_FRAME frame; // the frame to send
+        uint32_t timestamp; // Clock::micros() when the frame was queued
+        bool routed; // queued by a route, it is only replaced by routed frames
+    };
+    struct CanRxEntry {
+        CAN_FRAME frame; // the received frame (frame.time contains the hardware timestamp of the mailbox)
+        uint32_t timestamp; // Clock::micros() when the frame was taken from the mailbox
+    };
+
     CanBusNode canBusNode;  // indicator to which can bus this instance is assigned to
-    CANRaw *bus;    // the can bus instance which this CanHandler instance is assigned to
+    CANRaw *bus;    // the can bus instance which this CanHandler instance is assigned to, NULL for the internal bus
+
     CanObserverData observerData[CFG_CAN_NUM_OBSERVERS];    // Can observers
+    int16_t exactIndex[CFG_CAN_ID_HASH_SIZE]; // hash table (open addressing) of the first observerData entry per exact id, -1 = empty
+    int16_t maskedIndex[CFG_CAN_NUM_OBSERVERS]; // observerData entries which subscribed to a range of id's (mask)
+    uint16_t maskedCount; // number of used elements in maskedIndex
+    CanFilter filter[CFG_CAN_NUM_MAILBOXES]; // the filters which are programmed to the rx mailboxes
+    uint8_t filterCount; // number of rx mailboxes in use
+    uint8_t numRxMailboxes; // number of mailboxes which are available for reception
+    bool promiscuous; // receive all frames regardless of the subscriptions
+    CanRoute routes[CFG_CAN_NUM_ROUTES]; // frames which are forwarded to other buses in the receive interrupt (see handleReceive())
+    volatile uint8_t routeCount; // number of used entries in routes[], only modified with interrupts disabled
+    CanRxEntry rxBuffer[CFG_CAN_RX_BUFFER_SIZE]; // single-producer (interrupt) / single-consumer (process) ring of received frames
+    volatile uint16_t rxHead, rxTail; // head is only written by the interrupt, tail only by process()
+    volatile uint32_t overrunCount; // number of frames which were dropped because rxBuffer was full
+    uint32_t reportedOverrunCount; // overrunCount when the last warning was logged
+    uint32_t receiveTime; // timestamp of the frame which is currently dispatched
+    CanTxEntry txQueue[NUM_TX_PRIORITIES][CFG_CAN_TX_QUEUE_SIZE]; // per priority a ring of frames waiting for a free tx mailbox
+    uint8_t txHead[NUM_TX_PRIORITIES], txTail[NUM_TX_PRIORITIES]; // only modified in a critical section
+    uint8_t txDepth; // number of frames in all tx queues
+    uint8_t txHighWater; // maximum of txDepth since the statistics were reset
+    uint32_t txSent, txReplaced, txDropped; // number of frames handed to a mailbox, superseded by a newer frame, lost because the queue was full
+    uint32_t txLatencyMin, txLatencyMax; // time from queuing to hand-over to a mailbox in microseconds
+    uint64_t txLatencySum;
+    uint32_t bitRate; // bits per second of the bus
+    volatile uint32_t rxFrames, rxBits; // received frames / bits (incl. frames lost by an overrun) since the statistics were reset
+    uint32_t txBits; // bits of the sent frames since the statistics were reset
+    volatile uint32_t windowBits; // bits received and sent in the current load window
+    uint32_t windowStart; // Clock::millis() when the current load window started
+    uint32_t loadBits[CFG_CAN_LOAD_WINDOWS]; // bits per completed load window (ring)
+    uint16_t loadTime[CFG_CAN_LOAD_WINDOWS]; // effective duration of the completed load windows in ms
+    uint8_t loadIndex; // next entry in loadBits/loadTime to overwrite
+    uint16_t load; // bus load in 0.1% over all windows
+    uint16_t peakLoad; // highest load of a single window in 0.1% since the statistics were reset
+    uint32_t lastStatus; // CAN_SR of the last check of the error state
+    uint8_t rxErrorMax, txErrorMax; // highest error counters since the statistics were reset
+    uint16_t busOffCount; // number of times the controller went bus-off since the statistics were reset
 
-    int8_t findFreeObserverData();
+    int16_t findFreeObserverData();
+    bool isExactMask(uint32_t mask, bool extended);
+    uint8_t hashId(uint32_t id, bool extended);
+    int16_t findExact(uint32_t id, bool extended);
+    void rebuildIndex();
+    uint8_t calculateFilters(CanFilter *filters);
+    uint8_t openFilters(CanFilter *filters);
+    bool isCovered(CanFilter *filter, CanFilter *by);
+    void updateFilters();
+    void dispatch(CanRxEntry *entry);
+    void route(CAN_FRAME *frame);
+    bool queueReceived(CAN_FRAME *frame);
+    bool enqueue(CAN_FRAME& frame, TxPriority priority, bool replace, bool routed = false);
+    bool isTxMailboxFree();
+    void transmit();
+    static uint16_t frameBits(CAN_FRAME *frame);
+    void updateLoad();
+    uint16_t calculateLoad(uint32_t bits, uint32_t time);
+    void checkErrorState();
+    void sendDiagnostic();
 };
 
 extern CanHandler canHandlerEv;
 extern CanHandler canHandlerCar;
+extern CanHandler canHandlerInternal;
+
+void canEvReceiveInterrupt(CAN_FRAME *frame);
+void canCarReceiveInterrupt(CAN_FRAME *frame);
 
 #endif /* CAN_HANDLER_H_ */
@@ -34,7 +34,9 @@ CanIO::CanIO() :
 {
     prefsHandler = new PrefHandler(CAN_IO);
     lastReception = 0xffffff;
+    logicIO = 0;
     commonName = "Can I/O";
+    defaultTickInterval = CFG_TICK_INTERVAL_CAN_IO;
 }
 
 /**
@@ -72,8 +74,10 @@ void CanIO::setup()
     ready = true;
     powerOn = true;
 
-    canHandlerEv.attach(this, CAN_MASKED_ID, CAN_MASK, false);
-    tickHandler.attach(this, CFG_TICK_INTERVAL_CAN_IO);
+    canHandlerEv.attach(this, CAN_ID_GEVCU_STATUS, CAN_MASK_EXACT, false);
+    canHandlerEv.attach(this, CAN_ID_GEVCU_ANALOG_IO, CAN_MASK_EXACT, false);
+    tickHandler.attach(this, getTickInterval(), TickHandler::PRIORITY_SAFETY);
+    udsServer.attach(this, UDS_DID_LOGIC_IO);
 }
 
 /**
@@ -82,7 +86,9 @@ void CanIO::setup()
 void CanIO::tearDown()
 {
     Device::tearDown();
-    canHandlerEv.detach(this, CAN_MASKED_ID, CAN_MASK);
+    canHandlerEv.detach(this, CAN_ID_GEVCU_STATUS, CAN_MASK_EXACT);
+    canHandlerEv.detach(this, CAN_ID_GEVCU_ANALOG_IO, CAN_MASK_EXACT);
+    udsServer.detach(this);
 
     resetOutput(); // safety: release all output signals
 }
@@ -93,7 +99,7 @@ void CanIO::tearDown()
 void CanIO::handleTick()
 {
     // safety: if CAN messages from GEVCU are missing, fault the system
-    if (millis() > lastReception + CFG_CAN_IO_MSG_TIMEOUT) {
+    if (Clock::millis() > lastReception + CFG_CAN_IO_MSG_TIMEOUT) {
         Logger::error(this, "too many lost messages !");
         status.setSystemState(Status::error);
     }
@@ -163,7 +169,7 @@ void CanIO::handleCanFrame(CAN_FRAME *frame)
     case CAN_ID_GEVCU_STATUS:
         processGevcuStatus(frame);
         running = true;
-        lastReception = millis();
+        lastReception = Clock::millis();
         break;
 
     case CAN_ID_GEVCU_ANALOG_IO:
@@ -172,6 +178,15 @@ void CanIO::handleCanFrame(CAN_FRAME *frame)
     }
 }
 
+/*
+ * Provide the logic I/O bits for a UDS ReadDataByIdentifier request.
+ */
+uint16_t CanIO::readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength)
+{
+    UdsServer::putUInt16(data, logicIO);
+    return 2;
+}
+
 /*
  * Process a status message which was received from the GEVCU
  * and set system state and I/O accordingly
@@ -182,9 +197,9 @@ void CanIO::processGevcuStatus(CAN_FRAME *frame)
 
     // safety: set the system state, a error will cause a call of tearDown()
     // and prevent any activation of outputs.
-    status.setSystemState((Status::SystemState) frame->data.byte[4]);
+    status.setSystemState((Status::SystemState) GevcuSystemStateSignal::decode(frame));
 
-    uint16_t logicIO = frame->data.s1;
+    logicIO = GevcuLogicIOSignal::decode(frame);
 
     setOutput(config->prechargeRelayOutput, logicIO & preChargeRelay);
     setOutput(config->mainContactorOutput, logicIO & mainContactor);
@@ -206,10 +221,17 @@ void CanIO::processGevcuStatus(CAN_FRAME *frame)
     setOutput(config->powerSteeringOutput, logicIO & powerSteering);
     setOutput(config->unusedOutput, logicIO & unused);
 
+    CAN_FRAME internalFrame;
+    canHandlerInternal.prepareOutputFrame(&internalFrame, CAN_ID_INTERNAL_GEVCU_STATUS);
+    internalFrame.length = 3;
+    InternalLogicIOSignal::encode(internalFrame.data, logicIO);
+    InternalSystemStateSignal::encode(internalFrame.data, GevcuSystemStateSignal::decode(frame));
+    canHandlerInternal.sendFrame(internalFrame, CanHandler::TX_PRIORITY_TELEMETRY);
+
     if (Logger::isDebug()) {
         Logger::debug(this,
                 "state: %d, pre-charge: %d, main: %d, secondary: %d, fast chrg: %d, motor: %d, charger: %d, DCDC: %d",
-                frame->data.byte[4], logicIO & preChargeRelay, logicIO & mainContactor, logicIO & secondaryContactor, logicIO & fastChargeContactor,
+                GevcuSystemStateSignal::decode(frame), logicIO & preChargeRelay, logicIO & mainContactor, logicIO & secondaryContactor, logicIO & fastChargeContactor,
                 logicIO & enableMotor, logicIO & enableCharger, logicIO & enableDcDc);
         Logger::debug(this,
                 "heater: %d, valve: %d, pump: %d, cooling pump: %d, fan: %d, brake: %d, reverse: %d, power steer: %d, unused: %d",
@@ -223,10 +245,10 @@ void CanIO::processGevcuStatus(CAN_FRAME *frame)
  */
 void CanIO::processGevcuAnalogIO(CAN_FRAME *frame)
 {
-    status.analogIn[0] = frame->data.s0;
-    status.analogIn[1] = frame->data.s1;
-    status.analogIn[2] = frame->data.s2;
-    status.analogIn[3] = frame->data.s3;
+    status.analogIn[0] = GevcuAnalogIn1Signal::decode(frame);
+    status.analogIn[1] = GevcuAnalogIn2Signal::decode(frame);
+    status.analogIn[2] = GevcuAnalogIn3Signal::decode(frame);
+    status.analogIn[3] = GevcuAnalogIn4Signal::decode(frame);
 }
 
 DeviceType CanIO::getType()
@@ -282,6 +304,7 @@ void CanIO::loadConfiguration()
         prefsHandler->read(EECAN_WARNING_OUTPUT, &config->powerSteeringOutput);
         prefsHandler->read(EECAN_POWER_LIMITATION_OUTPUT, &config->unusedOutput);
     } else { //checksum invalid, reinitialize values and store to EEPROM
+        config->tickInterval = defaultTickInterval;
         config->prechargeRelayOutput = 22;
         config->mainContactorOutput = 23;
         config->secondaryContactorOutput = 24;
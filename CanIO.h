@@ -32,6 +32,8 @@
 #include "TickHandler.h"
 #include "CanHandler.h"
 #include "DeviceManager.h"
+#include "CanSignal.h"
+#include "UdsServer.h"
 
 // CAN bus id's for frames sent to the heater
 //TODO: define correct can ID's, mask and masked id's
@@ -42,8 +44,22 @@
 
 #define CAN_ID_GEVCU_STATUS     0x724 // receive status message                  11100100100
 #define CAN_ID_GEVCU_ANALOG_IO  0x725 // receive status message                  11100100101
-#define CAN_MASK                0x7fe // mask for above id's                     11111111110
-#define CAN_MASKED_ID           0x724 // masked id for id's from 0x258 to 0x268  11100100100
+#define CAN_MASK_EXACT          0x7ff // mask to subscribe to exactly one id     11111111111
+
+// signals of the GEVCU_STATUS frame
+typedef CanSignal<16, 16> GevcuLogicIOSignal; // bits of CanIO::GEVCU_LogicIO
+typedef CanSignal<32, 8> GevcuSystemStateSignal; // Status::SystemState
+
+// signals of the GEVCU_ANALOG_IO frame
+typedef CanSignal<0, 16> GevcuAnalogIn1Signal;
+typedef CanSignal<16, 16> GevcuAnalogIn2Signal;
+typedef CanSignal<32, 16> GevcuAnalogIn3Signal;
+typedef CanSignal<48, 16> GevcuAnalogIn4Signal;
+
+// the GEVCU status as published on the internal bus
+#define CAN_ID_INTERNAL_GEVCU_STATUS 0x300
+typedef CanSignal<0, 16> InternalLogicIOSignal; // bits of CanIO::GEVCU_LogicIO
+typedef CanSignal<16, 8> InternalSystemStateSignal; // Status::SystemState
 
 class CanIOConfiguration: public DeviceConfiguration
 {
@@ -69,7 +85,7 @@ public:
     uint8_t unusedOutput;
 };
 
-class CanIO: public Device, CanObserver
+class CanIO: public Device, CanObserver, UdsObserver
 {
 public:
     // Message id=0x724, GEVCU_STATUS
@@ -120,6 +136,7 @@ public:
     void tearDown();
     void handleTick();
     void handleCanFrame(CAN_FRAME *frame);
+    uint16_t readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength);
     void processGevcuStatus(CAN_FRAME *frame);
     void processGevcuAnalogIO(CAN_FRAME *frame);
     DeviceId getId();
@@ -131,6 +148,7 @@ protected:
 
 private:
     long lastReception;
+    uint16_t logicIO; // the last logic I/O bits received from GEVCU (see GEVCU_LogicIO)
     CAN_FRAME outputFrame; // the output CAN frame;
 
     void resetOutput();
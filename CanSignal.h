@@ -0,0 +1,139 @@
+/*
+ * CanSignal.h
+ *
+ * Compile-time description of a signal in a CAN frame (like a signal in a DBC file)
+ * with the functions to decode and encode it.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CANSIGNAL_H_
+#define CANSIGNAL_H_
+
+#include <Arduino.h>
+#include "due_can.h"
+
+enum CanByteOrder {
+    CAN_INTEL, // little endian, the start bit is the least significant bit of the signal
+    CAN_MOTOROLA // big endian, the start bit is the most significant bit of the signal (DBC numbering)
+};
+
+enum CanValueType {
+    CAN_UNSIGNED, // the raw value is unsigned
+    CAN_SIGNED // the raw value is a two's complement
+};
+
+/*
+ * A signal of a CAN frame. All parameters are template arguments, so the position
+ * and scaling are resolved by the compiler and decode()/encode() compile to the
+ * same shift and mask operations which would be written by hand.
+ *
+ * physical value = raw * factor / divisor + offset
+ *
+ * \param startBit - bit number of the LSB (Intel) or MSB (Motorola) as in a DBC file (byte n, bit b = n * 8 + b)
+ * \param length - number of bits (1 - 32)
+ * \param order - byte order of the signal
+ * \param type - signed or unsigned raw value
+ * \param T - type of the physical value
+ * \param factor, divisor, offset - integer scaling of the raw value
+ */
+template<uint8_t startBit, uint8_t length, CanByteOrder order = CAN_INTEL, CanValueType type = CAN_UNSIGNED, typename T = uint32_t,
+        int32_t factor = 1, int32_t divisor = 1, int32_t offset = 0>
+class CanSignal
+{
+public:
+    static const uint32_t mask = (uint32_t) ((1ull << length) - 1);
+    // position of the LSB in the 64 bit value (Intel: data.value, Motorola: data.value with reversed byte order)
+    static const uint8_t shift = (order == CAN_INTEL ? startBit : (7 - startBit / 8) * 8 + startBit % 8 - (length - 1));
+    // Intel signals of 8, 16 or 32 bits on a byte boundary are accessed directly (the processor is little endian)
+    static const bool aligned = (order == CAN_INTEL && startBit % 8 == 0 && (length == 8 || length == 16 || length == 32));
+
+    /*
+     * Get the raw value of the signal.
+     */
+    static inline uint32_t decodeRaw(const BytesUnion &data)
+    {
+        if (aligned) {
+            uint32_t raw = 0;
+            memcpy(&raw, data.bytes + shift / 8, length / 8);
+            return raw;
+        }
+        return (uint32_t) (value(data) >> shift) & mask;
+    }
+
+    /*
+     * Set the raw value of the signal, the other bits of the data remain unchanged.
+     */
+    static inline void encodeRaw(BytesUnion &data, uint32_t raw)
+    {
+        if (aligned) {
+            memcpy(data.bytes + shift / 8, &raw, length / 8);
+            return;
+        }
+        uint64_t bits = (value(data) & ~((uint64_t) mask << shift)) | ((uint64_t) (raw & mask) << shift);
+        data.value = (order == CAN_INTEL ? bits : __builtin_bswap64(bits));
+    }
+
+    /*
+     * Get the physical value of the signal.
+     */
+    static inline T decode(const BytesUnion &data)
+    {
+        int64_t raw = decodeRaw(data);
+
+        if (type == CAN_SIGNED && (raw & (1ul << (length - 1)))) { // sign extension
+            raw -= (int64_t) 1 << length;
+        }
+        return (T) (raw * factor / divisor + offset);
+    }
+
+    static inline T decode(const CAN_FRAME *frame)
+    {
+        return decode(frame->data);
+    }
+
+    /*
+     * Set the physical value of the signal, it is limited to the range of the signal.
+     */
+    static inline void encode(BytesUnion &data, T physical)
+    {
+        int64_t raw = ((int64_t) physical - offset) * divisor / factor;
+        int64_t minimum = (type == CAN_SIGNED ? -((int64_t) 1 << (length - 1)) : 0);
+        int64_t maximum = (type == CAN_SIGNED ? ((int64_t) 1 << (length - 1)) - 1 : (int64_t) mask);
+
+        encodeRaw(data, (uint32_t) constrain(raw, minimum, maximum));
+    }
+
+    static inline void encode(CAN_FRAME *frame, T physical)
+    {
+        encode(frame->data, physical);
+    }
+
+private:
+    static inline uint64_t value(const BytesUnion &data)
+    {
+        return (order == CAN_INTEL ? data.value : __builtin_bswap64(data.value));
+    }
+};
+
+#endif /* CANSIGNAL_H_ */
@@ -0,0 +1,52 @@
+/*
+ * Clock.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "Clock.h"
+
+#ifdef CFG_SIMULATION
+uint64_t Clock::simulatedTime = 0;
+
+/*
+ * Move the virtual clock forward.
+ */
+void Clock::advance(uint32_t microseconds)
+{
+    simulatedTime += microseconds;
+}
+#endif
+
+/*
+ * Wait for a number of milliseconds. In simulation the virtual clock
+ * is advanced instead of waiting.
+ */
+void Clock::delay(uint32_t milliseconds)
+{
+#ifdef CFG_SIMULATION
+    advance(milliseconds * 1000);
+#else
+    ::delay(milliseconds);
+#endif
+}
@@ -0,0 +1,60 @@
+/*
+ * Clock.h
+ *
+ * Time base of all devices. On the target the Arduino millis()/micros() are
+ * used. With CFG_SIMULATION defined, a virtual clock is used instead which
+ * is only advanced by TickHandler::simulate() (or advance()), so the tick
+ * driven logic can be run much faster than real time.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+class Clock
+{
+public:
+#ifdef CFG_SIMULATION
+    static uint32_t millis() { return (uint32_t) (simulatedTime / 1000); }
+    static uint32_t micros() { return (uint32_t) simulatedTime; }
+    static uint64_t micros64() { return simulatedTime; } // does not overflow after 71 minutes like micros()
+    static void advance(uint32_t microseconds);
+#else
+    static uint32_t millis() { return ::millis(); }
+    static uint32_t micros() { return ::micros(); }
+#endif
+    static uint32_t wallMicros() { return ::micros(); } // real time, used to measure durations
+    static uint32_t wallMillis() { return ::millis(); } // real time, used to measure long durations (e.g. the simulation speed)
+    static void delay(uint32_t milliseconds);
+
+private:
+#ifdef CFG_SIMULATION
+    static uint64_t simulatedTime; // virtual time in microseconds
+#endif
+};
+
+#endif /* CLOCK_H_ */
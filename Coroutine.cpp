@@ -0,0 +1,59 @@
+/*
+ * Coroutine.cpp
+ *
+ * Base class of stackless coroutines which are resumed by the TickHandler.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "Coroutine.h"
+#include "Logger.h"
+
+/*
+ * Constructor
+ */
+Coroutine::Coroutine()
+{
+    coroutineState = 0;
+    coroutineTimestamp = 0;
+}
+
+/*
+ * Default implementation of the Coroutine method. Must be overwritten
+ * by every sub-class.
+ *
+ * \retval true if the coroutine has to be resumed again, false if it is finished
+ */
+bool Coroutine::runCoroutine()
+{
+    Logger::error("Coroutine does not implement runCoroutine()");
+    return false;
+}
+
+/*
+ * Make the coroutine start from the beginning on its next resume.
+ */
+void Coroutine::resetCoroutine()
+{
+    coroutineState = 0;
+}
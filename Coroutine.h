@@ -0,0 +1,83 @@
+/*
+ * Coroutine.h
+ *
+ * Lightweight stackless coroutines (protothreads) which allow a device to
+ * write a multi-step I/O sequence with waits as straight-line code without
+ * blocking the main loop.
+ *
+ * A class derives from Coroutine, implements runCoroutine() using the macros
+ * below and is started with tickHandler.startCoroutine(). The TickHandler
+ * resumes it on every loop until it reaches COROUTINE_END().
+ *
+ * Example:
+ *
+ * bool MyDevice::runCoroutine()
+ * {
+ *     COROUTINE_BEGIN();
+ *     doX();
+ *     COROUTINE_DELAY(5);
+ *     doY();
+ *     COROUTINE_END();
+ * }
+ *
+ * NOTE: Local variables are not preserved across COROUTINE_YIELD(), COROUTINE_WAIT_UNTIL()
+ *       or COROUTINE_DELAY(), use member variables instead. A switch statement must not
+ *       contain one of these macros.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+#include <Arduino.h>
+#include "Clock.h"
+
+// start of the coroutine body, continues where the coroutine yielded the last time
+#define COROUTINE_BEGIN() switch (coroutineState) { case 0:
+
+// give control back to the main loop, continue here on the next resume
+#define COROUTINE_YIELD() do { coroutineState = __LINE__; return true; case __LINE__:; } while (0)
+
+// give control back to the main loop until the condition is true
+#define COROUTINE_WAIT_UNTIL(condition) do { coroutineState = __LINE__; case __LINE__: if (!(condition)) return true; } while (0)
+
+// wait the specified number of milliseconds without blocking the main loop
+#define COROUTINE_DELAY(ms) do { coroutineTimestamp = Clock::millis(); COROUTINE_WAIT_UNTIL(Clock::millis() - coroutineTimestamp >= (uint32_t) (ms)); } while (0)
+
+// end of the coroutine body, the coroutine is finished
+#define COROUTINE_END() } coroutineState = 0; return false;
+
+class Coroutine
+{
+public:
+    Coroutine();
+    virtual bool runCoroutine();
+    void resetCoroutine();
+
+protected:
+    uint16_t coroutineState; // the line where the coroutine continues, 0 = beginning
+    uint32_t coroutineTimestamp; // start time of the current COROUTINE_DELAY()
+};
+
+#endif /* COROUTINE_H_ */
@@ -0,0 +1,59 @@
+/*
+ * CriticalSection.h
+ *
+ * Critical sections which may be nested and may be entered from interrupt
+ * context. Unlike noInterrupts()/interrupts(), leaving the section restores
+ * the previous interrupt state instead of unconditionally enabling interrupts,
+ * so an interrupt handler is not preempted after calling a function which uses it.
+ *
+ *     uint32_t primask = enterCritical();
+ *     ... // change the data shared with interrupt handlers
+ *     leaveCritical(primask);
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CRITICALSECTION_H_
+#define CRITICALSECTION_H_
+
+#include <Arduino.h>
+
+/*
+ * Disable the interrupts and return the previous state to pass to leaveCritical().
+ */
+static inline uint32_t enterCritical()
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+/*
+ * Restore the interrupt state returned by enterCritical().
+ */
+static inline void leaveCritical(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+#endif /* CRITICALSECTION_H_ */
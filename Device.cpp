@@ -35,6 +35,7 @@ Device::Device()
     prefsHandler = NULL;
 
     commonName = "Generic Device";
+    defaultTickInterval = 0;
     deviceConfiguration = NULL;
 
     ready = false;
@@ -209,12 +210,71 @@ DeviceId Device::getId()
     return INVALID;
 }
 
+/**
+ * Load the configuration values which are common to all devices.
+ * Devices without own configuration class get an instance of DeviceConfiguration.
+ * The stored tick interval is only used if the checksum of the device's EEPROM
+ * area is valid and the value is within the valid range, otherwise the device's
+ * default is used.
+ */
 void Device::loadConfiguration()
 {
+    DeviceConfiguration *config = getConfiguration();
+
+    if (!config) {
+        config = new DeviceConfiguration();
+        setConfiguration(config);
+    }
+
+    config->tickInterval = 0;
+#ifndef USE_HARD_CODED
+    if (prefsHandler != NULL && prefsHandler->checksumValid()) {
+        prefsHandler->read(EE_TICK_INTERVAL, &config->tickInterval);
+    }
+#endif
+    if (config->tickInterval < CFG_TICK_INTERVAL_MIN || config->tickInterval > CFG_TICK_INTERVAL_MAX) {
+        config->tickInterval = defaultTickInterval;
+    }
 }
 
+/**
+ * Store the configuration values which are common to all devices.
+ */
 void Device::saveConfiguration()
 {
+    DeviceConfiguration *config = getConfiguration();
+
+    if (prefsHandler != NULL && config != NULL) {
+        prefsHandler->write(EE_TICK_INTERVAL, config->tickInterval);
+    }
+}
+
+/**
+ * Get the configured tick interval of the device in microseconds.
+ */
+uint32_t Device::getTickInterval()
+{
+    DeviceConfiguration *config = getConfiguration();
+
+    return (config != NULL ? config->tickInterval : defaultTickInterval);
+}
+
+/**
+ * Change the tick interval of the device (microseconds). A running device is
+ * re-timed immediately. The value is stored in the EEPROM with the next
+ * saveConfiguration().
+ */
+void Device::setTickInterval(uint32_t interval)
+{
+    DeviceConfiguration *config = getConfiguration();
+
+    if (config == NULL || interval < CFG_TICK_INTERVAL_MIN || interval > CFG_TICK_INTERVAL_MAX) {
+        Logger::error(this, "invalid tick interval %dus", interval);
+        return;
+    }
+    config->tickInterval = interval;
+    tickHandler.setInterval(this, interval);
+    Logger::info(this, "tick interval set to %dus", interval);
 }
 
 DeviceConfiguration *Device::getConfiguration()
@@ -44,7 +44,8 @@ class DeviceManager;
  */
 class DeviceConfiguration
 {
-
+public:
+    uint32_t tickInterval; // interval in microseconds at which the device is ticked
 };
 
 /*
@@ -77,10 +78,13 @@ public:
     virtual void saveConfiguration();
     DeviceConfiguration *getConfiguration();
     void setConfiguration(DeviceConfiguration *);
+    uint32_t getTickInterval();
+    void setTickInterval(uint32_t interval);
 
 protected:
     PrefHandler *prefsHandler; // pointer to device specific instance of PrefHandler
     char *commonName; // the device's common name
+    uint32_t defaultTickInterval; // tick interval (microseconds) used if none is stored in the EEPROM
 
     bool ready; // set if the device itself reports that it's ready for operation
     bool running; // set if the device itself reports that it's running / active
@@ -12,6 +12,16 @@
  need only call these existing functions but the manager interface needs to
  expose a way to register them with the system.
 
+ The id and type of every device are cached when it is added. The devices are indexed
+ by id (hash table) and by type (one chain per type), so looking up a device and
+ sending a message to a type only touch the matching devices.
+
+ Messages are queued (together with a copy of their payload) and delivered in order
+ from process() in the main loop, so e.g. a state change which is triggered by a
+ received CAN frame doesn't set up or tear down all devices while the CanHandler is
+ still dispatching. Only safety relevant messages are delivered immediately with
+ sendMessageSync(), a state change sent this way supersedes the queued ones.
+
  Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
  Permission is hereby granted, free of charge, to any person obtaining
@@ -44,6 +54,9 @@ DeviceManager::DeviceManager()
     for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
         devices[i] = NULL;
     }
+    rebuildIndex();
+    queueHead = queueTail = 0;
+    resetStatistics();
 }
 
 /*
@@ -58,6 +71,9 @@ void DeviceManager::addDevice(Device *device)
 
         if (i != -1) {
             devices[i] = device;
+            deviceId[i] = device->getId();
+            deviceType[i] = device->getType();
+            rebuildIndex();
         } else {
             Logger::error(device, "unable to register device, max number of devices reached.");
         }
@@ -69,15 +85,240 @@ void DeviceManager::addDevice(Device *device)
  */
 void DeviceManager::removeDevice(Device *device)
 {
-    int8_t i = findDevice(NULL);
+    int8_t i = findDevice(device);
 
-    if (i != -1) {
+    if (i != -1 && device != NULL) {
         devices[i] = NULL;
+        rebuildIndex();
+    }
+}
+
+/*
+ * Calculate the position of a device id in the idIndex hash table.
+ */
+uint8_t DeviceManager::hashId(DeviceId id)
+{
+    return (id ^ (id >> 5) ^ (id >> 10)) & (CFG_DEV_MGR_ID_HASH_SIZE - 1);
+}
+
+/*
+ * Re-build the id and type index after a device was added or removed.
+ */
+void DeviceManager::rebuildIndex()
+{
+    for (int i = 0; i < CFG_DEV_MGR_ID_HASH_SIZE; i++) {
+        idIndex[i] = -1;
+    }
+    for (int i = 0; i <= DEVICE_NONE; i++) {
+        firstOfType[i] = -1;
+    }
+
+    for (int i = CFG_DEV_MGR_MAX_DEVICES - 1; i >= 0; i--) { // backwards, so the chains are in order of registration
+        nextOfType[i] = -1;
+        if (devices[i] == NULL) {
+            continue;
+        }
+
+        uint8_t pos = hashId(deviceId[i]);
+        while (idIndex[pos] != -1) {
+            pos = (pos + 1) & (CFG_DEV_MGR_ID_HASH_SIZE - 1);
+        }
+        idIndex[pos] = i;
+
+        if (deviceType[i] <= DEVICE_NONE) {
+            nextOfType[i] = firstOfType[deviceType[i]];
+            firstOfType[deviceType[i]] = i;
+        }
     }
 }
 
 /*
- Send an inter-device message. Devtype has to be filled out but could be DEVICE_ANY.
+ * Look up a device by its id.
+ *
+ * \retval array index into devices[] or -1 if no device has the id
+ */
+int8_t DeviceManager::findById(DeviceId id)
+{
+    for (uint8_t pos = hashId(id), count = 0; count < CFG_DEV_MGR_ID_HASH_SIZE; pos = (pos + 1) & (CFG_DEV_MGR_ID_HASH_SIZE - 1), count++) {
+        int8_t entry = idIndex[pos];
+
+        if (entry == -1 || deviceId[entry] == id) {
+            return entry;
+        }
+    }
+    return -1;
+}
+
+/*
+ Queue an inter-device message which is delivered with the next process() (see sendMessageSync()
+ for the addressing). The message is copied into the queue, so length must be the size of the
+ data message points to (max CFG_DEV_MGR_MESSAGE_SIZE), a message without length is rejected.
+ Don't queue messages which contain pointers to temporary data.
+ May also be called from interrupt context.
+
+ \retval true if the message was queued (not that a device handled it already)
+ \retval false if no device matches the type/id, the length is invalid or the queue is full
+ */
+bool DeviceManager::sendMessage(DeviceType devType, DeviceId devId, uint32_t msgType, void* message, uint8_t length)
+{
+    if (length > CFG_DEV_MGR_MESSAGE_SIZE) {
+        Logger::error("message %#x too long (%d bytes), increase CFG_DEV_MGR_MESSAGE_SIZE", msgType, length);
+        return false;
+    }
+    if (message != NULL && length == 0) {
+        Logger::error("message %#x has no length, it can't be queued", msgType);
+        return false;
+    }
+    if (!hasRecipient(devType, devId)) {
+        return false;
+    }
+
+    uint32_t primask = enterCritical();
+    uint8_t head = queueHead;
+    uint8_t next = (head + 1) % CFG_DEV_MGR_QUEUE_SIZE;
+    if (next == queueTail) {
+        dropped++;
+        leaveCritical(primask);
+        return false;
+    }
+
+    DeviceMessage *entry = &queue[head];
+    entry->deviceType = devType;
+    entry->deviceId = devId;
+    entry->msgType = msgType;
+    entry->timestamp = Clock::micros();
+    entry->length = (message == NULL ? 0 : length);
+    if (entry->length > 0) {
+        memcpy(entry->payload, message, entry->length);
+    }
+    queueHead = next;
+    queued++;
+
+    uint8_t depth = (next + CFG_DEV_MGR_QUEUE_SIZE - queueTail) % CFG_DEV_MGR_QUEUE_SIZE;
+    if (depth > queueHighWater) {
+        queueHighWater = depth;
+    }
+    leaveCritical(primask);
+    return true;
+}
+
+/*
+ * Check if at least one registered device would get a message to the type/id.
+ */
+bool DeviceManager::hasRecipient(DeviceType devType, DeviceId devId)
+{
+    if (devId != INVALID) {
+        int8_t i = findById(devId);
+        return i != -1 && (devType == DEVICE_ANY || devType == deviceType[i]);
+    }
+    if (devType != DEVICE_ANY) {
+        return devType <= DEVICE_NONE && firstOfType[devType] != -1;
+    }
+    return true;
+}
+
+/*
+ * Check if a registered device gets a message to the type/id.
+ */
+bool DeviceManager::isRecipient(int8_t index, DeviceType devType, DeviceId devId)
+{
+    return devices[index] != NULL && (devId == INVALID || devId == deviceId[index])
+            && (devType == DEVICE_ANY || devType == deviceType[index]);
+}
+
+/*
+ * Remove the queued messages of a type which would reach at least one of the recipients
+ * of a message to the type/id, e.g. state changes which are superseded by a newer one.
+ * The order of the remaining messages is kept.
+ */
+void DeviceManager::discard(DeviceType devType, DeviceId devId, uint32_t msgType)
+{
+    uint32_t primask = enterCritical();
+    uint8_t write = queueTail;
+
+    for (uint8_t read = queueTail; read != queueHead; read = (read + 1) % CFG_DEV_MGR_QUEUE_SIZE) {
+        DeviceMessage *message = &queue[read];
+        bool affected = false;
+
+        if (message->msgType == msgType) {
+            for (int8_t i = 0; i < CFG_DEV_MGR_MAX_DEVICES && !affected; i++) {
+                affected = isRecipient(i, message->deviceType, message->deviceId) && isRecipient(i, devType, devId);
+            }
+        }
+        if (affected) {
+            superseded++;
+            continue;
+        }
+        if (write != read) {
+            queue[write] = *message;
+        }
+        write = (write + 1) % CFG_DEV_MGR_QUEUE_SIZE;
+    }
+    queueHead = write;
+    leaveCritical(primask);
+}
+
+/*
+ * Take the oldest message from the queue.
+ *
+ * \retval false if the queue is empty
+ */
+bool DeviceManager::dequeue(DeviceMessage *message)
+{
+    uint32_t primask = enterCritical();
+    if (queueTail == queueHead) {
+        leaveCritical(primask);
+        return false;
+    }
+    *message = queue[queueTail];
+    queueTail = (queueTail + 1) % CFG_DEV_MGR_QUEUE_SIZE;
+    leaveCritical(primask);
+
+    uint32_t latency = Clock::micros() - message->timestamp;
+    latencySum += latency;
+    if (latency > latencyMax) {
+        latencyMax = latency;
+    }
+    delivered++;
+    return true;
+}
+
+/*
+ * Deliver the queued messages in the order they were sent. Messages which are
+ * sent while the queue is processed are delivered in the next loop, so two devices
+ * can't keep process() busy by answering each other's messages.
+ */
+void DeviceManager::process()
+{
+    DeviceMessage message;
+    uint8_t count = (queueHead + CFG_DEV_MGR_QUEUE_SIZE - queueTail) % CFG_DEV_MGR_QUEUE_SIZE;
+
+    while (count-- > 0 && dequeue(&message)) {
+        dispatch(message.deviceType, message.deviceId, message.msgType, (message.length == 0 ? NULL : message.payload));
+    }
+
+    uint32_t lost = dropped;
+    if (lost != reportedDropped) {
+        Logger::error("message queue full, %d messages lost", lost - reportedDropped);
+        reportedDropped = lost;
+    }
+}
+
+/*
+ * Check if no message is waiting to be delivered.
+ */
+bool DeviceManager::isIdle()
+{
+    return queueHead == queueTail;
+}
+
+/*
+ Send an inter-device message immediately, only to be used on safety relevant paths
+ (e.g. a transition to the error state) or with temporary data. A state change
+ supersedes the queued state changes to the same devices, they are discarded so no
+ stale transition is delivered before or after it. All other queued messages remain
+ queued and are delivered with the next process().
+ Devtype has to be filled out but could be DEVICE_ANY.
  If devId is anything other than INVALID (0xFFFF) then the message will be targetted to only
  one device. Otherwise it will broadcast to any device that matches the device type (or all
  devices in the case of DEVICE_ANY).
@@ -85,29 +326,67 @@ void DeviceManager::removeDevice(Device *device)
  whatever you want. The standard message types are to enforce standard messages for easy
  intercommunication.
  */
-bool DeviceManager::sendMessage(DeviceType devType, DeviceId devId, uint32_t msgType, void* message)
+bool DeviceManager::sendMessageSync(DeviceType devType, DeviceId devId, uint32_t msgType, void* message)
+{
+    if (msgType == MSG_STATE_CHANGE) {
+        discard(devType, devId, msgType);
+    }
+    return dispatch(devType, devId, msgType, message);
+}
+
+/*
+ * Pass a message to all enabled devices which match the type/id.
+ * Messages to a device id or a type are only delivered via the index, only a broadcast
+ * to DEVICE_ANY visits all devices.
+ *
+ * \retval true if at least one device got the message
+ */
+bool DeviceManager::dispatch(DeviceType devType, DeviceId devId, uint32_t msgType, void *message)
 {
     bool foundDevice = false;
-    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
-        if (devices[i] && (devices[i]->isEnabled() || msgType == MSG_ENABLE)) { //does this object exist and is it enabled?
-            if (devType == DEVICE_ANY || devType == devices[i]->getType()) {
-                if (devId == INVALID || devId == devices[i]->getId()) {
-                    if (Logger::isDebug()) {
-                        Logger::debug("Sending msg %#x to device %#x", msgType, devices[i]->getId());
-                    }
-                    devices[i]->handleMessage(msgType, message);
-                    foundDevice = true;
-                }
+
+    if (devId != INVALID) {
+        int8_t i = findById(devId);
+        if (i != -1 && (devType == DEVICE_ANY || devType == deviceType[i])) {
+            foundDevice = deliver(i, msgType, message);
+        }
+    } else if (devType != DEVICE_ANY) {
+        for (int8_t i = (devType <= DEVICE_NONE ? firstOfType[devType] : -1); i != -1; i = nextOfType[i]) {
+            foundDevice |= deliver(i, msgType, message);
+        }
+    } else {
+        for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
+            if (devices[i]) {
+                foundDevice |= deliver(i, msgType, message);
             }
         }
     }
     return foundDevice;
 }
 
+/*
+ * Pass a message to a device if it is enabled (or if the device shall be enabled).
+ *
+ * \retval true if the device got the message
+ */
+bool DeviceManager::deliver(int8_t index, uint32_t msgType, void *message)
+{
+    Device *device = devices[index];
+
+    if (!device->isEnabled() && msgType != MSG_ENABLE) {
+        return false;
+    }
+    if (Logger::isDebug()) {
+        Logger::debug("Sending msg %#x to device %#x", msgType, deviceId[index]);
+    }
+    device->handleMessage(msgType, message);
+    return true;
+}
+
 void DeviceManager::setParameter(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, char *key, char *value)
 {
     char *params[] = { key, value };
-    sendMessage(deviceType, deviceId, msgType, params);
+    sendMessageSync(deviceType, deviceId, msgType, params); // the parameters are temporary, can't be queued
 }
 
 void DeviceManager::setParameter(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, char *key, uint32_t value)
@@ -124,12 +403,10 @@ but sometimes you can't help it.
 */
 Device *DeviceManager::getDeviceByID(DeviceId id)
 {
-    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
-        if (devices[i]) {
-            if (devices[i]->getId() == id) {
-                return devices[i];
-            }
-        }
+    int8_t i = findById(id);
+
+    if (i != -1) {
+        return devices[i];
     }
 
     Logger::debug("getDeviceByID - No device with ID: %#x", (int) id);
@@ -142,11 +419,9 @@ a given type and that is enabled.
 */
 Device *DeviceManager::getDeviceByType(DeviceType type)
 {
-    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
-        if (devices[i]) {
-            if (devices[i]->getType() == type && devices[i]->isEnabled()) {
-                return devices[i];
-            }
+    for (int8_t i = (type <= DEVICE_NONE ? firstOfType[type] : -1); i != -1; i = nextOfType[i]) {
+        if (devices[i]->isEnabled()) {
+            return devices[i];
         }
     }
     return NULL;
@@ -167,13 +442,40 @@ int8_t DeviceManager::findDevice(Device *device)
     return -1;
 }
 
+/*
+ * Print the number of messages, the throughput, the queue depth and the delivery latency.
+ */
+void DeviceManager::printStatistics()
+{
+    uint32_t duration = (Clock::millis() - statisticsStart) / 1000;
+
+    Logger::console("messages: %d queued (%d/sec), %d delivered, %d dropped, %d superseded, queue %d (max %d), latency %d/%dus", queued,
+            (duration == 0 ? queued : queued / duration), delivered, dropped, superseded,
+            (queueHead + CFG_DEV_MGR_QUEUE_SIZE - queueTail) % CFG_DEV_MGR_QUEUE_SIZE, queueHighWater,
+            (uint32_t) (delivered == 0 ? 0 : latencySum / delivered), latencyMax);
+}
+
+/*
+ * Reset the message statistics.
+ */
+void DeviceManager::resetStatistics()
+{
+    uint32_t primask = enterCritical();
+    queued = delivered = dropped = reportedDropped = superseded = 0;
+    queueHighWater = (queueHead + CFG_DEV_MGR_QUEUE_SIZE - queueTail) % CFG_DEV_MGR_QUEUE_SIZE;
+    leaveCritical(primask);
+    latencyMax = 0;
+    latencySum = 0;
+    statisticsStart = Clock::millis();
+}
+
 void DeviceManager::printDeviceList()
 {
     Logger::console("Currently enabled devices: (DISABLE= to disable)");
 
     for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
         if (devices[i] && devices[i]->isEnabled()) {
-            Logger::console("     %#x     %s", devices[i]->getId(), devices[i]->getCommonName());
+            Logger::console("     %#x     %s (tick %dus)", devices[i]->getId(), devices[i]->getCommonName(), devices[i]->getTickInterval());
         }
     }
 
@@ -28,6 +28,8 @@
 
 #include "config.h"
 #include "Logger.h"
+#include "Clock.h"
+#include "CriticalSection.h"
 #include "Device.h"
 #include "Sys_Messages.h"
 #include "DeviceTypes.h"
@@ -40,19 +42,56 @@ public:
     DeviceManager();
     void addDevice(Device *device);
     void removeDevice(Device *device);
-    bool sendMessage(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void* message);
+    bool sendMessage(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void* message = NULL, uint8_t length = 0);
+    bool sendMessageSync(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void* message);
+    void process();
+    bool isIdle();
     void setParameter(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, char *key, char *value);
     void setParameter(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, char *key, uint32_t value);
     Device *getDeviceByID(DeviceId);
     Device *getDeviceByType(DeviceType);
     void printDeviceList();
+    void printStatistics();
+    void resetStatistics();
 
 protected:
 
 private:
+    struct DeviceMessage {
+        DeviceType deviceType; // the type of the recipients (DEVICE_ANY = all)
+        DeviceId deviceId; // the recipient (INVALID = all of the type)
+        uint32_t msgType; // the type of the message (see SystemMessage)
+        uint32_t timestamp; // Clock::micros() when the message was queued
+        uint8_t length; // number of bytes in payload, 0 = the message has no payload (NULL is passed)
+        uint32_t payload[CFG_DEV_MGR_MESSAGE_SIZE / 4]; // copy of the message (word aligned)
+    };
+
     Device *devices[CFG_DEV_MGR_MAX_DEVICES];
+    DeviceId deviceId[CFG_DEV_MGR_MAX_DEVICES]; // cached id of the devices
+    DeviceType deviceType[CFG_DEV_MGR_MAX_DEVICES]; // cached type of the devices
+    int8_t nextOfType[CFG_DEV_MGR_MAX_DEVICES]; // next device of the same type (index into devices, -1 = none)
+    int8_t firstOfType[DEVICE_NONE + 1]; // first device per type (index into devices, -1 = none)
+    int8_t idIndex[CFG_DEV_MGR_ID_HASH_SIZE]; // hash table (open addressing) of the devices by id, -1 = empty
+    DeviceMessage queue[CFG_DEV_MGR_QUEUE_SIZE]; // ring of messages waiting to be delivered
+    volatile uint8_t queueHead, queueTail; // only modified with interrupts disabled
+    uint8_t queueHighWater; // maximum number of waiting messages since the statistics were reset
+    uint32_t queued, delivered, dropped; // messages put into the queue / taken from the queue / lost because the queue was full
+    uint32_t reportedDropped; // dropped when the last error was logged
+    uint32_t superseded; // queued state changes which were discarded by a synchronous one
+    uint32_t latencyMax; // time from queuing to delivery in microseconds
+    uint64_t latencySum;
+    uint32_t statisticsStart; // Clock::millis() when the statistics were reset
 
     int8_t findDevice(Device *device);
+    int8_t findById(DeviceId id);
+    uint8_t hashId(DeviceId id);
+    void rebuildIndex();
+    bool deliver(int8_t index, uint32_t msgType, void *message);
+    bool dispatch(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void *message);
+    bool hasRecipient(DeviceType deviceType, DeviceId deviceId);
+    bool isRecipient(int8_t index, DeviceType deviceType, DeviceId deviceId);
+    void discard(DeviceType deviceType, DeviceId deviceId, uint32_t msgType);
+    bool dequeue(DeviceMessage *message);
 };
 
 extern DeviceManager deviceManager;
@@ -34,7 +34,10 @@ EberspaecherHeater::EberspaecherHeater() :
 {
     prefsHandler = new PrefHandler(EBERSPAECHER);
     powerRequested = 0;
+    externalTemperature = 999;
+    externalTemperatureTime = 0;
     commonName = "Eberspaecher Heater";
+    defaultTickInterval = CFG_TICK_INTERVAL_EBERSPAECHER_HEATER;
 }
 
 /**
@@ -49,11 +52,11 @@ void EberspaecherHeater::setup()
     digitalWrite(CFG_CAN1_HV_MODE_PIN, HIGH);
 
     prepareFrames();
-    temperatureDevice = (Temperature *)deviceManager.getDeviceByID(TEMPERATURE);
     ready = true;
 
-    canHandlerCar.attach(this, CAN_MASKED_ID, CAN_MASK, true);
-    tickHandler.attach(this, CFG_TICK_INTERVAL_EBERSPAECHER_HEATER);
+    canHandlerCar.attach(this, CAN_ID_STATUS, CAN_MASK_EXTENDED_EXACT, true);
+    canHandlerInternal.attach(this, CAN_ID_INTERNAL_TEMPERATURE, CAN_MASK_INTERNAL_TEMPERATURE, false);
+    tickHandler.attach(this, getTickInterval(), TickHandler::PRIORITY_CONTROL);
 }
 
 /**
@@ -61,12 +64,24 @@ void EberspaecherHeater::setup()
  */
 void EberspaecherHeater::tearDown()
 {
+    bool wasRunning = running;
+
     Device::tearDown();
 
+    if (tickHandler.isCoroutineRunning(this)) { // abort a wake-up in progress
+        tickHandler.stopCoroutine(this);
+        digitalWrite(CFG_CAN1_HV_MODE_PIN, HIGH); // set normal mode
+    }
+    stopCycles();
+
     powerRequested = 0;
-    sendControl();
+    if (wasRunning) { // request zero power
+        frameControl.frame.data.byte[1] = 0;
+        canHandlerCar.sendFrame(frameControl.frame, CanHandler::TX_PRIORITY_CONTROL, true);
+    }
 
-    canHandlerEv.detach(this, CAN_MASKED_ID, CAN_MASK);
+    canHandlerCar.detach(this, CAN_ID_STATUS, CAN_MASK_EXTENDED_EXACT);
+    canHandlerInternal.detach(this, CAN_ID_INTERNAL_TEMPERATURE, CAN_MASK_INTERNAL_TEMPERATURE);
 }
 
 /**
@@ -76,6 +91,9 @@ void EberspaecherHeater::handleTick()
 {
     calculatePower();
     sendControl();
+
+    // while the heater is off, it's sufficient to check the conditions less often
+    tickHandler.setInterval(this, powerOn || running ? getTickInterval() : CFG_TICK_INTERVAL_EBERSPAECHER_HEATER_IDLE);
 }
 
 /*
@@ -83,6 +101,11 @@ void EberspaecherHeater::handleTick()
  */
 void EberspaecherHeater::handleCanFrame(CAN_FRAME *frame)
 {
+    if (!frame->extended && (frame->id & CAN_MASK_INTERNAL_TEMPERATURE) == CAN_ID_INTERNAL_TEMPERATURE) {
+        processTemperature(frame);
+        return;
+    }
+
     canHandlerCar.logFrame(*frame);
 
     switch (frame->id) {
@@ -95,18 +118,27 @@ void EberspaecherHeater::handleCanFrame(CAN_FRAME *frame)
 /*
  * Wake up all SW-CAN devices by switching the transceiver to HV mode and
  * sending the command 0x100 and switching the HV mode off again.
+ * The wake-up runs as coroutine, so the main loop is not blocked while waiting.
  */
 void EberspaecherHeater::sendWakeup()
 {
-    Logger::debug(this, "sending wake-up signal");
-    digitalWrite(CFG_CAN1_HV_MODE_PIN, LOW); // set HV mode
+    tickHandler.startCoroutine(this);
+}
 
-    // 0x100, False, 0, 00,00,00,00,00,00,00,00
-    canHandlerCar.prepareOutputFrame(&frameControl, CAN_ID_WAKEUP);
-    canHandlerCar.sendFrame(frameControl);
-    delay(5);
+/*
+ * The wake-up sequence (see sendWakeup()).
+ */
+bool EberspaecherHeater::runCoroutine()
+{
+    COROUTINE_BEGIN();
 
+    Logger::debug(this, "sending wake-up signal");
+    digitalWrite(CFG_CAN1_HV_MODE_PIN, LOW); // set HV mode
+    canHandlerCar.sendFrame(frameWakeup);
+    COROUTINE_DELAY(5);
     digitalWrite(CFG_CAN1_HV_MODE_PIN, HIGH); // set normal mode
+
+    COROUTINE_END();
 }
 
 /*
@@ -114,37 +146,85 @@ void EberspaecherHeater::sendWakeup()
  */
 void EberspaecherHeater::prepareFrames()
 {
+    // 0x100, False, 0, 00,00,00,00,00,00,00,00
+    canHandlerCar.prepareOutputFrame(&frameWakeup, CAN_ID_WAKEUP);
     // 0x621, False, 8, 00,40,00,00,00,00,00,00 - keep alive
-    canHandlerCar.prepareOutputFrame(&frameKeepAlive, CAN_ID_KEEP_ALIVE);
-    frameKeepAlive.length = 8;
-    frameKeepAlive.data.byte[1] = 0x40;
+    canHandlerCar.prepareOutputFrame(&frameKeepAlive.frame, CAN_ID_KEEP_ALIVE);
+    frameKeepAlive.frame.length = 8;
+    frameKeepAlive.frame.data.byte[1] = 0x40;
     // 0x13FFE060, True, 0, 00,00,00,00,00,00,00,00 - cmd1
-    canHandlerCar.prepareOutputFrame(&frameCmd1, CAN_ID_CMD1);
-    frameCmd1.extended = 1;
+    canHandlerCar.prepareOutputFrame(&frameCmd1.frame, CAN_ID_CMD1);
+    frameCmd1.frame.extended = 1;
     // 0x102CC040, True, 8, 01,01,CF,0F,00,51,46,60 - cmd2
-    canHandlerCar.prepareOutputFrame(&frameCmd2, CAN_ID_CMD2);
-    frameCmd2.extended = 1;
-    frameCmd2.length = 8;
-    frameCmd2.data.value = 0x0101CF0F00514660;
+    canHandlerCar.prepareOutputFrame(&frameCmd2.frame, CAN_ID_CMD2);
+    frameCmd2.frame.extended = 1;
+    frameCmd2.frame.length = 8;
+    frameCmd2.frame.data.value = 0x0101CF0F00514660;
     // 0x10242040, True, 1, 00,00,00,00,00,00,00,00 - cmd3
-    canHandlerCar.prepareOutputFrame(&frameCmd3, CAN_ID_CMD3);
-    frameCmd3.extended = 1;
-    frameCmd3.length = 1;
+    canHandlerCar.prepareOutputFrame(&frameCmd3.frame, CAN_ID_CMD3);
+    frameCmd3.frame.extended = 1;
+    frameCmd3.frame.length = 1;
     // 0x102740CB, True, 3, 2D,00,00,00,00,00,00,00 - cmd4
-    canHandlerCar.prepareOutputFrame(&frameCmd4, CAN_ID_CMD4);
-    frameCmd4.extended = 1;
-    frameCmd4.length = 3;
-    frameCmd4.data.byte[0] = 0x2d;
+    canHandlerCar.prepareOutputFrame(&frameCmd4.frame, CAN_ID_CMD4);
+    frameCmd4.frame.extended = 1;
+    frameCmd4.frame.length = 3;
+    frameCmd4.frame.data.byte[0] = 0x2d;
     // 0x102740CB, True, 3, 19,00,00,00,00,00,00,00 - cmd5
-    canHandlerCar.prepareOutputFrame(&frameCmd5, CAN_ID_CMD5);
-    frameCmd5.extended = 1;
-    frameCmd5.length = 3;
-    frameCmd5.data.byte[0] = 0x19;
+    canHandlerCar.prepareOutputFrame(&frameCmd5.frame, CAN_ID_CMD5);
+    frameCmd5.frame.extended = 1;
+    frameCmd5.frame.length = 3;
+    frameCmd5.frame.data.byte[0] = 0x19;
     // 0x10720099, True, 5, 02,3E,00,00,00,00,00,00 - control
-    canHandlerCar.prepareOutputFrame(&frameControl, CAN_ID_CONTROL);
-    frameControl.extended = 1;
-    frameControl.length = 5;
-    frameControl.data.byte[0] = 0x02;
+    canHandlerCar.prepareOutputFrame(&frameControl.frame, CAN_ID_CONTROL);
+    frameControl.frame.extended = 1;
+    frameControl.frame.length = 5;
+    frameControl.frame.data.byte[0] = 0x02;
+}
+
+/*
+ * Start the cyclic transmission of the frames which the heater expects while it's running.
+ * The frames are spread across the cycle in the order the heater expects them.
+ * Only cmd4 and cmd5 share the same id, so they must not replace each other in the queue.
+ */
+void EberspaecherHeater::startCycles()
+{
+    uint32_t step = CFG_CAN_CYCLE_EBERSPAECHER_HEATER / 10;
+
+    frameKeepAlive.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 0);
+    frameCmd1.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, step);
+    frameControl.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 2 * step);
+    frameCmd2.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 3 * step);
+    frameCmd3.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 4 * step);
+    frameCmd4.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 5 * step, CanHandler::TX_PRIORITY_CONTROL, false);
+    frameCmd5.start(&canHandlerCar, CFG_CAN_CYCLE_EBERSPAECHER_HEATER, 6 * step, CanHandler::TX_PRIORITY_CONTROL, false);
+}
+
+/*
+ * Stop the cyclic transmission of all frames.
+ */
+void EberspaecherHeater::stopCycles()
+{
+    frameKeepAlive.stop();
+    frameCmd1.stop();
+    frameControl.stop();
+    frameCmd2.stop();
+    frameCmd3.stop();
+    frameCmd4.stop();
+    frameCmd5.stop();
+}
+
+/*
+ * Take the temperature of the configured external sensor from the frames
+ * which the temperature device publishes on the internal bus.
+ */
+void EberspaecherHeater::processTemperature(CAN_FRAME *frame)
+{
+    EberspaecherHeaterConfiguration *config = (EberspaecherHeaterConfiguration *) getConfiguration();
+
+    if (!memcmp(frame->data.bytes + 2, config->extTemperatureSensorAddress + 1, 6)) {
+        externalTemperature = InternalTemperatureSignal::decode(frame) / 10.0f;
+        externalTemperatureTime = Clock::millis();
+    }
 }
 
 /*
@@ -153,14 +233,13 @@ void EberspaecherHeater::prepareFrames()
 void EberspaecherHeater::calculatePower()
 {
     EberspaecherHeaterConfiguration *config = (EberspaecherHeaterConfiguration *) getConfiguration();
-    float extnernalTemperature = 999;
     int16_t waterTemperature = 1270; // tenth degree C
 
     powerRequested = 0;
 
-    // get external temperature
-    if (temperatureDevice->isRunning()) {
-        extnernalTemperature = temperatureDevice->getSensorTemperature(config->extTemperatureSensorAddress);
+    // the external temperature is unknown if the sensor stopped reporting
+    if (Clock::millis() - externalTemperatureTime > CFG_INTERNAL_TEMPERATURE_TIMEOUT) {
+        externalTemperature = 999;
     }
     // get water temperature from heater's temperature sensor
     if (status.analogIn[0] != 0) {
@@ -169,7 +248,7 @@ void EberspaecherHeater::calculatePower()
     }
 
     // power on the device only if the external temperature is lower than or equal to configured temperature
-    if (extnernalTemperature <= config->extTemperatureOn || config->extTemperatureOn == 255) {
+    if (externalTemperature <= config->extTemperatureOn || config->extTemperatureOn == 255) {
         powerOn = true;
     } else {
         powerOn = false;
@@ -188,14 +267,16 @@ void EberspaecherHeater::calculatePower()
 
     if (Logger::isDebug()) {
         Logger::debug(this, "analog in: %d, water temperature: %fC, ext temperature: %f, power requested: %d, power on: %d",
-                status.analogIn[0], waterTemperature / 10.0f, extnernalTemperature, powerRequested, powerOn);
+                status.analogIn[0], waterTemperature / 10.0f, externalTemperature, powerRequested, powerOn);
     }
 }
 
 /*
  * Send control message to the heater.
  *
- * This message controls the power-stage in the heater
+ * This message controls the power-stage in the heater. After the wake-up the
+ * frames are sent cyclically (see startCycles()), only the requested power is
+ * updated here.
  */
 void EberspaecherHeater::sendControl()
 {
@@ -205,35 +286,30 @@ void EberspaecherHeater::sendControl()
             running = true;
             return;
         }
+        if (tickHandler.isCoroutineRunning(this)) { // wake-up still in progress
+            return;
+        }
     } else {
         if (running) {
+            stopCycles();
             // request zero power
-            frameControl.data.byte[1] = 0;
-            canHandlerCar.sendFrame(frameControl);
+            frameControl.frame.data.byte[1] = 0;
+            canHandlerCar.sendFrame(frameControl.frame, CanHandler::TX_PRIORITY_CONTROL, true);
             running = false;
         }
         return;
     }
 
-    // map requested power (percentage) to valid range of heater (0 - 0x85)
-    frameControl.data.byte[1] = map(constrain(powerRequested, 0, MAX_POWER_WATT), 0, MAX_POWER_WATT, 0, 0x85);
+    // map requested power (percentage) to valid range of heater (0 - 0x85), a single byte can be updated while the frame is cycling
+    frameControl.frame.data.byte[1] = map(constrain(powerRequested, 0, MAX_POWER_WATT), 0, MAX_POWER_WATT, 0, 0x85);
 
     if (Logger::isDebug()) {
-//        canHandlerCar.logFrame(frameKeepAlive);
-//        canHandlerCar.logFrame(frameCmd1);
-//        canHandlerCar.logFrame(frameControl);
-//        canHandlerCar.logFrame(frameCmd2);
-//        canHandlerCar.logFrame(frameCmd3);
-//        canHandlerCar.logFrame(frameCmd4);
-//        canHandlerCar.logFrame(frameCmd5);
+//        canHandlerCar.logFrame(frameControl.frame);
+    }
+
+    if (!frameControl.isActive()) {
+        startCycles();
     }
-    canHandlerCar.sendFrame(frameKeepAlive);
-    canHandlerCar.sendFrame(frameCmd1);
-    canHandlerCar.sendFrame(frameControl);
-    canHandlerCar.sendFrame(frameCmd2);
-    canHandlerCar.sendFrame(frameCmd3);
-    canHandlerCar.sendFrame(frameCmd4);
-    canHandlerCar.sendFrame(frameCmd5);
 }
 
 /*
@@ -294,6 +370,7 @@ config->extTemperatureSensorAddress[5] = 0x14;
 config->extTemperatureSensorAddress[6] = 0x2;
 config->extTemperatureSensorAddress[7] = 0x49;
     } else { //checksum invalid, reinitialize values and store to EEPROM
+        config->tickInterval = defaultTickInterval;
         config->maxPower = 4000;
         config->targetTemperature = 80;
         config->deratingTemperature = 70;
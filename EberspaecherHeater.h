@@ -10,6 +10,7 @@
 #include "config.h"
 #include "TickHandler.h"
 #include "CanHandler.h"
+#include "CanCyclicFrame.h"
 #include "DeviceManager.h"
 #include "Temperature.h"
 
@@ -27,10 +28,9 @@
 
 // CAN bus id's for frames received from the heater
 
-//TODO: define correct can ID's, mask and masked id's
+//TODO: define correct can ID's
 #define CAN_ID_STATUS           0x13FFE09D // receive status message             10011111111111110000010011101
-#define CAN_MASK                0x0   // mask for above id's                     00000000000
-#define CAN_MASKED_ID           0x0   // masked id for id's from 0x258 to 0x268  00000000000
+#define CAN_MASK_EXTENDED_EXACT 0x1fffffff // mask to subscribe to exactly one extended id
 
 class EberspaecherHeaterConfiguration: public DeviceConfiguration
 {
@@ -42,7 +42,7 @@ public:
     uint8_t extTemperatureSensorAddress[8]; // address of external temperature sensor
 };
 
-class EberspaecherHeater: public Device, CanObserver
+class EberspaecherHeater: public Device, CanObserver, Coroutine
 {
 public:
     EberspaecherHeater();
@@ -51,6 +51,8 @@ public:
     void handleTick();
     void handleCanFrame(CAN_FRAME *frame);
     void processStatus(uint8_t *data);
+    void processTemperature(CAN_FRAME *frame);
+    bool runCoroutine();
     DeviceId getId();
     DeviceType getType();
     void loadConfiguration();
@@ -59,20 +61,24 @@ public:
 protected:
 
 private:
-    CAN_FRAME frameControl; // frame to send control messages
-    CAN_FRAME frameKeepAlive; // frame to send heart beat
-    CAN_FRAME frameCmd1; // frame to send cmd1 message
-    CAN_FRAME frameCmd2; // frame to send cmd2 message
-    CAN_FRAME frameCmd3; // frame to send cmd3 message
-    CAN_FRAME frameCmd4; // frame to send cmd4 message
-    CAN_FRAME frameCmd5; // frame to send cmd5 message
+    CAN_FRAME frameWakeup; // frame to wake up the SW-CAN devices
+    CanCyclicFrame frameControl; // frame to send control messages
+    CanCyclicFrame frameKeepAlive; // frame to send heart beat
+    CanCyclicFrame frameCmd1; // frame to send cmd1 message
+    CanCyclicFrame frameCmd2; // frame to send cmd2 message
+    CanCyclicFrame frameCmd3; // frame to send cmd3 message
+    CanCyclicFrame frameCmd4; // frame to send cmd4 message
+    CanCyclicFrame frameCmd5; // frame to send cmd5 message
     uint16_t powerRequested; // value from 0 to 6000 watt
-    Temperature *temperatureDevice;
+    float externalTemperature; // last temperature of the external sensor in deg C (999 = unknown)
+    uint32_t externalTemperatureTime; // Clock::millis() when the external temperature was received
 
     void calculatePower();
     void sendControl();
     void sendWakeup();
     void prepareFrames();
+    void startCycles();
+    void stopCycles();
 };
 
 #endif /* EBERSPAECHERHEATER_H_ */
@@ -37,6 +37,7 @@ FlowMeter::FlowMeter(DeviceId devId, uint8_t pin) :
     oldTime = 0;
 
     prefsHandler = new PrefHandler(id);
+    defaultTickInterval = CFG_TICK_INTERVAL_FLOW_METER;
     if (id == FLOW_METER_COOLING) {
         commonName =  "Flow Meter Cooling";
     } else {
@@ -52,6 +53,7 @@ void FlowMeter::setup()
 
     pinMode(sensorPin, INPUT);
     digitalWrite(sensorPin, HIGH);
+    oldTime = Clock::millis();
 
     ready = true;
     powerOn = true;
@@ -60,15 +62,16 @@ void FlowMeter::setup()
     case FLOW_METER_COOLING:
         pulseCountCooling = 0;
         attachInterrupt(digitalPinToInterrupt(sensorPin), pulseCounterCooling, FALLING);
-        canHandlerEv.prepareOutputFrame(&outputFrame, CAN_ID_GEVCU_FLOW_COOL);
+        canHandlerEv.prepareOutputFrame(&outputFrame.frame, CAN_ID_GEVCU_FLOW_COOL);
         break;
     case FLOW_METER_HEATER:
         pulseCountHeater = 0;
         attachInterrupt(digitalPinToInterrupt(sensorPin), pulseCounterHeater, FALLING);
-        canHandlerEv.prepareOutputFrame(&outputFrame, CAN_ID_GEVCU_FLOW_HEAT);
+        canHandlerEv.prepareOutputFrame(&outputFrame.frame, CAN_ID_GEVCU_FLOW_HEAT);
         break;
     }
-    tickHandler.attach(this, CFG_TICK_INTERVAL_FLOW_METER);
+    tickHandler.attach(this, getTickInterval(), TickHandler::PRIORITY_TELEMETRY);
+    udsServer.attach(this, (id == FLOW_METER_COOLING ? UDS_DID_FLOW_COOLING : UDS_DID_FLOW_HEATER));
 }
 
 /**
@@ -77,6 +80,8 @@ void FlowMeter::setup()
 void FlowMeter::tearDown()
 {
     Device::tearDown();
+    outputFrame.stop();
+    udsServer.detach(this);
     detachInterrupt(digitalPinToInterrupt(sensorPin));
 }
 
@@ -86,7 +91,7 @@ void FlowMeter::tearDown()
 void FlowMeter::handleTick()
 {
     FlowMeterConfiguration *config = (FlowMeterConfiguration *) getConfiguration();
-    unsigned long newTime = millis();
+    unsigned long newTime = Clock::millis();
 
     // copy over the value of pulseCount and reset the pulse counter so we can start incrementing again in interrupts
     uint16_t pulses = 0;
@@ -101,18 +106,42 @@ void FlowMeter::handleTick()
         break;
     }
 
+    if (tickHandler.getMissedTicks() > 0) {
+        Logger::debug(this, "%d ticks missed, compensating", tickHandler.getMissedTicks());
+    }
+
     // part-of-one-second * 1000ml * pulses / pulses-per-liter
     flowMilliLiterPerSec = ((1000.0 / (newTime - oldTime)) * 1000 * pulses) / config->calibrationFactor;
     flowLiterPerMin = 60.0 * flowMilliLiterPerSec / 1000;
-    totalMilliLiter += flowMilliLiterPerSec;
+    // add the volume of the whole elapsed time, which covers missed ticks too
+    totalMilliLiter += flowMilliLiterPerSec * (newTime - oldTime) / 1000;
     oldTime = newTime;
 
     if (Logger::isDebug()) {
         Logger::info(this, "flow: %dml/sec, total: %dml", flowMilliLiterPerSec, totalMilliLiter);
     }
-    outputFrame.data.high = flowMilliLiterPerSec;
-    outputFrame.data.low = totalMilliLiter;
-    canHandlerEv.sendFrame(outputFrame);
+
+    // the frame is sent from the timer interrupt, don't let it see a half updated payload
+    noInterrupts();
+    FlowRateSignal::encode(outputFrame.frame.data, flowMilliLiterPerSec);
+    FlowTotalSignal::encode(outputFrame.frame.data, totalMilliLiter);
+    uint32_t sentFlow = FlowRateSignal::decode(outputFrame.sentData);
+    interrupts();
+
+    // every measurement is published on the internal bus
+    CAN_FRAME frame;
+    canHandlerInternal.prepareOutputFrame(&frame, (id == FLOW_METER_COOLING ? CAN_ID_INTERNAL_FLOW_COOL : CAN_ID_INTERNAL_FLOW_HEAT));
+    FlowRateSignal::encode(frame.data, flowMilliLiterPerSec);
+    FlowTotalSignal::encode(frame.data, totalMilliLiter);
+    canHandlerInternal.sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY);
+
+    if (!outputFrame.isActive()) {
+        outputFrame.setInhibitTime(CFG_CAN_INHIBIT_FLOW_METER);
+        outputFrame.start(&canHandlerEv, CFG_CAN_CYCLE_FLOW_METER, TickHandler::PHASE_AUTO, CanHandler::TX_PRIORITY_TELEMETRY);
+        outputFrame.trigger();
+    } else if (abs((int32_t) (flowMilliLiterPerSec - sentFlow)) >= CFG_CAN_DEADBAND_FLOW_METER) {
+        outputFrame.trigger(); // e.g. pump started or stopped, don't wait for the refresh
+    }
 }
 
 float FlowMeter::getFlowLiterPerMin()
@@ -130,6 +159,16 @@ uint32_t FlowMeter::getTotalMilliLiter()
     return totalMilliLiter;
 }
 
+/*
+ * Provide the flow rate and total volume for a UDS ReadDataByIdentifier request.
+ */
+uint16_t FlowMeter::readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength)
+{
+    UdsServer::putUInt32(data, flowMilliLiterPerSec);
+    UdsServer::putUInt32(data + 4, totalMilliLiter);
+    return 8;
+}
+
 DeviceType FlowMeter::getType()
 {
     return DEVICE_FLOW_METER;
@@ -165,6 +204,7 @@ void FlowMeter::loadConfiguration()
         uint16_t temp;
         prefsHandler->read(EEFLOW_CALIBRATION_FACTOR, &config->calibrationFactor);
     } else { //checksum invalid, reinitialize values and store to EEPROM
+        config->tickInterval = defaultTickInterval;
         config->calibrationFactor = 270; // some devices also give 450 pulses per liter
         saveConfiguration();
     }
@@ -12,9 +12,18 @@
 #include "config.h"
 #include "TickHandler.h"
 #include "CanHandler.h"
+#include "CanCyclicFrame.h"
+#include "CanSignal.h"
+#include "UdsServer.h"
 
 #define CAN_ID_GEVCU_FLOW_HEAT     0x729 // Flow CAN message heater
 #define CAN_ID_GEVCU_FLOW_COOL     0x72a // Flow CAN message cooling
+#define CAN_ID_INTERNAL_FLOW_COOL  0x310 // Flow on the internal bus, cooling (same layout as on the EV bus)
+#define CAN_ID_INTERNAL_FLOW_HEAT  0x311 // Flow on the internal bus, heater
+
+// signals of the flow frames
+typedef CanSignal<0, 32> FlowTotalSignal; // total volume in ml
+typedef CanSignal<32, 32> FlowRateSignal; // flow in ml/sec
 
 class FlowMeterConfiguration: public DeviceConfiguration
 {
@@ -22,7 +31,7 @@ public:
     uint16_t calibrationFactor; // the number of pulses per liter (usually 270)
 };
 
-class FlowMeter: public Device
+class FlowMeter: public Device, UdsObserver
 {
 public:
     FlowMeter(DeviceId id, uint8_t pin);
@@ -36,11 +45,12 @@ public:
     float getFlowLiterPerMin();
     uint32_t getFlowMilliLiterPerSec();
     uint32_t getTotalMilliLiter();
+    uint16_t readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength);
 
 protected:
 
 private:
-    CAN_FRAME outputFrame; // the output CAN frame
+    CanCyclicFrame outputFrame; // the output CAN frame, sent periodically once the first flow is measured
     DeviceId id;
     uint8_t sensorPin;
     float flowLiterPerMin; // flow rate in liter/min
@@ -9,6 +9,10 @@
 #include <Arduino.h>
 #include "DeviceManager.h"
 #include "CanHandler.h"
+#include "CanCapture.h"
+#include "CanGateway.h"
+#include "IsoTp.h"
+#include "UdsServer.h"
 #include "TickHandler.h"
 #include "Heartbeat.h"
 #include "Temperature.h"
@@ -23,6 +23,9 @@ void setup()
     memCache.setup();
     canHandlerEv.setup();
     canHandlerCar.setup();
+    canHandlerInternal.setup();
+    isoTp.setup();
+    udsServer.setup();
 
     createDevices();
     serialConsole.printMenu();
@@ -35,5 +38,19 @@ void loop()
     tickHandler.process();
     canHandlerEv.process();
     canHandlerCar.process();
+    canHandlerInternal.process();
+    deviceManager.process();
+    canCapture.process();
+    canGateway.process();
+    isoTp.process();
     serialConsole.loop();
+
+#ifdef CFG_IDLE_SLEEP
+    // check with interrupts disabled, so no interrupt can slip in between the check and the sleep
+    noInterrupts();
+    if (tickHandler.isIdle() && canHandlerEv.isIdle() && canHandlerCar.isIdle() && canHandlerInternal.isIdle() && deviceManager.isIdle() && canCapture.isIdle() && canGateway.isIdle() && isoTp.isIdle() && !SerialUSB.available()) {
+        tickHandler.sleep();
+    }
+    interrupts();
+#endif
 }
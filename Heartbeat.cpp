@@ -34,6 +34,7 @@ Heartbeat::Heartbeat() :
     dotCount = 0;
     lastTickTime = 0;
     commonName = "Heartbeat";
+    defaultTickInterval = CFG_TICK_INTERVAL_HEARTBEAT;
 }
 
 void Heartbeat::setup()
@@ -45,13 +46,13 @@ void Heartbeat::setup()
     ready = true;
     running = true;
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_HEARTBEAT);
+    tickHandler.attach(this, getTickInterval(), TickHandler::PRIORITY_HOUSEKEEPING);
 }
 
 void Heartbeat::handleTick()
 {
     // Print a dot if no other output has been made since the last tick
-    if (Logger::getLastLogTime() < lastTickTime) {
+    if (Logger::getLastLogTime() < lastTickTime && !Logger::isMuted()) {
         SerialUSB.print('.');
 
         if ((++dotCount % 80) == 0) {
@@ -59,7 +60,7 @@ void Heartbeat::handleTick()
         }
     }
 
-    lastTickTime = millis();
+    lastTickTime = Clock::millis();
 
     if (led) {
         digitalWrite(CFG_BLINK_LED, HIGH);
@@ -84,9 +85,12 @@ void Heartbeat::loadConfiguration()
 {
 //    HeartbeatConfiguration *config = (HeartbeatConfiguration *) getConfiguration();
 
+    Device::loadConfiguration(); // call parent
+
     if (prefsHandler->checksumValid()) { //checksum is good, read in the values stored in EEPROM
 //      prefsHandler->read(EESYS_, &config->);
     } else {
+        getConfiguration()->tickInterval = defaultTickInterval;
         saveConfiguration();
     }
 }
@@ -95,6 +99,8 @@ void Heartbeat::saveConfiguration()
 {
 //    HeartbeatConfiguration *config = (HeartbeatConfiguration *) getConfiguration();
 
+    Device::saveConfiguration(); // call parent
+
 //  prefsHandler->write(EESYS_, config->);
     prefsHandler->saveChecksum();
 }
@@ -0,0 +1,349 @@
+/*
+ * IsoTp.cpp
+ *
+ * Segmentation and reassembly of messages longer than 8 bytes according to
+ * ISO 15765-2 (ISO-TP) with normal addressing: single frames, first frame +
+ * consecutive frames and flow control with block size and separation time (STmin).
+ *
+ * Received frames are handled when the CanHandler dispatches them, the
+ * consecutive frames of an outgoing message are sent from process(), which is
+ * called in every loop, so neither side blocks the loop while a message is
+ * transferred.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "IsoTp.h"
+
+IsoTp isoTp(&canHandlerEv, CAN_ID_GEVCU_EXT_ISOTP_REQUEST, CAN_ID_GEVCU_EXT_ISOTP_RESPONSE);
+
+IsoTp::IsoTp(CanHandler *canHandler, uint32_t rxId, uint32_t txId)
+{
+    this->canHandler = canHandler;
+    this->rxId = rxId;
+    this->txId = txId;
+    listener = NULL;
+
+    rxLength = rxPosition = 0;
+    rxSequence = 0;
+    rxBlockCounter = 0;
+    rxTimestamp = 0;
+
+    txState = TX_IDLE;
+    txLength = txPosition = 0;
+    txSequence = 0;
+    txBlockSize = txBlockCounter = 0;
+    txSeparationTime = 0;
+    txTimestamp = 0;
+}
+
+/*
+ * Subscribe to the incoming frames, must be called after the CanHandler is set up.
+ */
+void IsoTp::setup()
+{
+    canHandler->attach(this, rxId, 0x7ff, false);
+}
+
+/*
+ * Set the object which gets the received messages.
+ */
+void IsoTp::setListener(IsoTpListener *listener)
+{
+    this->listener = listener;
+}
+
+/*
+ * Start to send a message. Messages of up to 7 bytes are sent in a single frame,
+ * longer ones with a first frame and consecutive frames after the receiver
+ * answered with a flow control frame.
+ *
+ * \retval false if a message is still being sent, the message is too long or the
+ *         (first) frame was dropped because the tx queue is full
+ */
+bool IsoTp::send(uint8_t *data, uint16_t length)
+{
+    CAN_FRAME frame;
+
+    if (txState != TX_IDLE) {
+        Logger::warn("ISO-TP %#x: previous message not sent yet", txId);
+        return false;
+    }
+    if (length > CFG_ISOTP_BUFFER_SIZE) {
+        Logger::error("ISO-TP %#x: message too long (%d bytes)", txId, length);
+        return false;
+    }
+
+    prepareFrame(&frame);
+    if (length <= 7) {
+        frame.data.byte[0] = SINGLE_FRAME | length;
+        memcpy(frame.data.bytes + 1, data, length);
+        return canHandler->sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY);
+    }
+
+    frame.data.byte[0] = FIRST_FRAME | (length >> 8);
+    frame.data.byte[1] = length & 0xff;
+    memcpy(frame.data.bytes + 2, data, 6);
+    if (!canHandler->sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY)) {
+        return false;
+    }
+
+    memcpy(txBuffer, data, length);
+    txLength = length;
+    txPosition = 6;
+    txSequence = 1;
+    txState = TX_WAIT_FLOW_CONTROL;
+    txTimestamp = Clock::micros();
+    return true;
+}
+
+/*
+ * Check if no message is being sent or received.
+ */
+bool IsoTp::isIdle()
+{
+    return txState == TX_IDLE && rxPosition == 0;
+}
+
+/*
+ * Send the next consecutive frame when the separation time is over and
+ * abort transfers of which the other side stopped responding.
+ */
+void IsoTp::process()
+{
+    if (txState == TX_SENDING) {
+        if (Clock::micros() - txTimestamp >= txSeparationTime && canHandler->hasTxQueueSpace(CanHandler::TX_PRIORITY_TELEMETRY)) {
+            sendConsecutiveFrame();
+        }
+    } else if (txState == TX_WAIT_FLOW_CONTROL) {
+        if (Clock::micros() - txTimestamp > CFG_ISOTP_TIMEOUT * 1000) {
+            Logger::warn("ISO-TP %#x: no flow control received, message aborted", txId);
+            txState = TX_IDLE;
+        }
+    }
+
+    if (rxPosition != 0 && Clock::millis() - rxTimestamp > CFG_ISOTP_TIMEOUT) {
+        Logger::warn("ISO-TP %#x: no consecutive frame received, message aborted", rxId);
+        rxPosition = 0;
+    }
+}
+
+/*
+ * Fill the frame with the id and padding bytes.
+ */
+void IsoTp::prepareFrame(CAN_FRAME *frame)
+{
+    canHandler->prepareOutputFrame(frame, txId);
+    memset(frame->data.bytes, CFG_ISOTP_PADDING, 8);
+}
+
+/*
+ * Send the next consecutive frame, wait for flow control after the last frame of a block.
+ */
+void IsoTp::sendConsecutiveFrame()
+{
+    CAN_FRAME frame;
+    uint16_t length = min(txLength - txPosition, 7);
+
+    prepareFrame(&frame);
+    frame.data.byte[0] = CONSECUTIVE_FRAME | txSequence;
+    memcpy(frame.data.bytes + 1, txBuffer + txPosition, length);
+    canHandler->sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY);
+
+    txPosition += length;
+    txSequence = (txSequence + 1) & 0x0f;
+    txTimestamp = Clock::micros();
+
+    if (txPosition >= txLength) {
+        txState = TX_IDLE;
+    } else if (txBlockSize != 0 && --txBlockCounter == 0) {
+        txState = TX_WAIT_FLOW_CONTROL;
+    }
+}
+
+/*
+ * Send a flow control frame with our block size and separation time.
+ */
+void IsoTp::sendFlowControl(FlowStatus status)
+{
+    CAN_FRAME frame;
+
+    prepareFrame(&frame);
+    frame.data.byte[0] = FLOW_CONTROL | status;
+    frame.data.byte[1] = CFG_ISOTP_BLOCK_SIZE;
+    frame.data.byte[2] = CFG_ISOTP_SEPARATION_TIME;
+    canHandler->sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY);
+}
+
+/*
+ * Convert STmin of a flow control frame into microseconds.
+ * 0x00-0x7f = 0-127ms, 0xf1-0xf9 = 100-900us, reserved values are treated as 127ms.
+ */
+uint32_t IsoTp::decodeSeparationTime(uint8_t stMin)
+{
+    if (stMin <= 0x7f) {
+        return stMin * 1000;
+    }
+    if (stMin >= 0xf1 && stMin <= 0xf9) {
+        return (stMin - 0xf0) * 100;
+    }
+    return 127000;
+}
+
+/*
+ * Handle a frame of the other side.
+ */
+void IsoTp::handleCanFrame(CAN_FRAME *frame)
+{
+    switch (frame->data.byte[0] & 0xf0) {
+    case SINGLE_FRAME: {
+        uint8_t length = frame->data.byte[0] & 0x0f;
+        if (length >= 1 && length <= 7 && length < frame->length) {
+            rxPosition = 0; // a single frame aborts a running reception
+            deliver(frame->data.bytes + 1, length);
+        }
+        break;
+    }
+    case FIRST_FRAME:
+        handleFirstFrame(frame);
+        break;
+    case CONSECUTIVE_FRAME:
+        handleConsecutiveFrame(frame);
+        break;
+    case FLOW_CONTROL:
+        handleFlowControl(frame);
+        break;
+    }
+}
+
+/*
+ * Start the reception of a multi-frame message and allow the sender to continue.
+ */
+void IsoTp::handleFirstFrame(CAN_FRAME *frame)
+{
+    uint16_t length = ((frame->data.byte[0] & 0x0f) << 8) | frame->data.byte[1];
+
+    if (frame->length < 8) { // a first frame always carries 2 bytes PCI and 6 bytes data
+        Logger::warn("ISO-TP %#x: first frame too short (%d bytes)", rxId, frame->length);
+        return;
+    }
+    if (length <= 7) { // must be sent as single frame
+        return;
+    }
+    if (length > CFG_ISOTP_BUFFER_SIZE) {
+        Logger::warn("ISO-TP %#x: message too long (%d bytes)", rxId, length);
+        sendFlowControl(FLOW_OVERFLOW);
+        rxPosition = 0;
+        return;
+    }
+
+    rxLength = length;
+    memcpy(rxBuffer, frame->data.bytes + 2, 6);
+    rxPosition = 6;
+    rxSequence = 1;
+    rxBlockCounter = CFG_ISOTP_BLOCK_SIZE;
+    rxTimestamp = Clock::millis();
+    sendFlowControl(FLOW_CONTINUE);
+}
+
+/*
+ * Add the data of a consecutive frame to the message, deliver the message when
+ * it's complete or request the next block.
+ */
+void IsoTp::handleConsecutiveFrame(CAN_FRAME *frame)
+{
+    if (rxPosition == 0) { // not expected
+        return;
+    }
+    if ((frame->data.byte[0] & 0x0f) != rxSequence) {
+        Logger::warn("ISO-TP %#x: wrong sequence number %d (expected %d), message aborted", rxId, frame->data.byte[0] & 0x0f, rxSequence);
+        rxPosition = 0;
+        return;
+    }
+
+    uint16_t length = min(rxLength - rxPosition, 7);
+    if (frame->length < 1 + length) {
+        Logger::warn("ISO-TP %#x: consecutive frame too short (%d bytes, expected %d), message aborted", rxId, frame->length, 1 + length);
+        rxPosition = 0;
+        return;
+    }
+    memcpy(rxBuffer + rxPosition, frame->data.bytes + 1, length);
+    rxPosition += length;
+    rxSequence = (rxSequence + 1) & 0x0f;
+    rxTimestamp = Clock::millis();
+
+    if (rxPosition >= rxLength) {
+        rxPosition = 0;
+        deliver(rxBuffer, rxLength);
+    } else if (CFG_ISOTP_BLOCK_SIZE != 0 && --rxBlockCounter == 0) {
+        rxBlockCounter = CFG_ISOTP_BLOCK_SIZE;
+        sendFlowControl(FLOW_CONTINUE);
+    }
+}
+
+/*
+ * Continue, wait or abort the transmission as requested by the receiver.
+ */
+void IsoTp::handleFlowControl(CAN_FRAME *frame)
+{
+    if (txState != TX_WAIT_FLOW_CONTROL || frame->length < 3) {
+        return;
+    }
+
+    switch (frame->data.byte[0] & 0x0f) {
+    case FLOW_CONTINUE:
+        txBlockSize = frame->data.byte[1];
+        txBlockCounter = txBlockSize;
+        txSeparationTime = decodeSeparationTime(frame->data.byte[2]);
+        txState = TX_SENDING;
+        break;
+    case FLOW_WAIT:
+        txTimestamp = Clock::micros(); // restart the timeout
+        break;
+    default:
+        Logger::warn("ISO-TP %#x: receiver rejected the message (overflow)", txId);
+        txState = TX_IDLE;
+        break;
+    }
+}
+
+/*
+ * Pass a complete message to the listener.
+ */
+void IsoTp::deliver(uint8_t *data, uint16_t length)
+{
+    if (listener != NULL) {
+        listener->handleIsoTpMessage(this, data, length);
+    } else {
+        Logger::debug("ISO-TP %#x: received %d bytes, no listener", rxId, length);
+    }
+}
+
+/*
+ * Default implementation of the IsoTpListener method. Must be overwritten
+ * by every sub-class.
+ */
+void IsoTpListener::handleIsoTpMessage(IsoTp *isoTp, uint8_t *data, uint16_t length)
+{
+    Logger::error("IsoTpListener does not implement handleIsoTpMessage(), %d bytes", length);
+}
@@ -0,0 +1,111 @@
+/*
+ * IsoTp.h
+ *
+ * ISO 15765-2 (ISO-TP) transport of messages up to 4095 bytes over CAN.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ISOTP_H_
+#define ISOTP_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "Logger.h"
+#include "Clock.h"
+
+#define CAN_ID_GEVCU_EXT_ISOTP_REQUEST  0x72e // ISO-TP requests to the GEVCU extension
+#define CAN_ID_GEVCU_EXT_ISOTP_RESPONSE 0x72f // ISO-TP responses of the GEVCU extension
+
+class IsoTp;
+
+class IsoTpListener
+{
+public:
+    virtual void handleIsoTpMessage(IsoTp *isoTp, uint8_t *data, uint16_t length);
+};
+
+class IsoTp: public CanObserver
+{
+public:
+    IsoTp(CanHandler *canHandler, uint32_t rxId, uint32_t txId);
+    void setup();
+    void setListener(IsoTpListener *listener);
+    bool send(uint8_t *data, uint16_t length);
+    bool isIdle();
+    void process();
+    void handleCanFrame(CAN_FRAME *frame);
+
+private:
+    enum FrameType {
+        SINGLE_FRAME = 0x00,
+        FIRST_FRAME = 0x10,
+        CONSECUTIVE_FRAME = 0x20,
+        FLOW_CONTROL = 0x30
+    };
+    enum FlowStatus {
+        FLOW_CONTINUE = 0x00,
+        FLOW_WAIT = 0x01,
+        FLOW_OVERFLOW = 0x02
+    };
+    enum TxState {
+        TX_IDLE,
+        TX_WAIT_FLOW_CONTROL, // first frame or last frame of a block sent, waiting for the receiver
+        TX_SENDING // sending consecutive frames
+    };
+
+    CanHandler *canHandler;
+    uint32_t rxId, txId; // the CAN id's of incoming and outgoing frames
+    IsoTpListener *listener; // gets the received messages
+
+    uint8_t rxBuffer[CFG_ISOTP_BUFFER_SIZE];
+    uint16_t rxLength; // total length of the message which is received
+    uint16_t rxPosition; // number of bytes received so far, 0 = no multi-frame reception in progress
+    uint8_t rxSequence; // expected sequence number of the next consecutive frame
+    uint8_t rxBlockCounter; // consecutive frames until the next flow control has to be sent
+    uint32_t rxTimestamp; // Clock::millis() of the last received frame
+
+    uint8_t txBuffer[CFG_ISOTP_BUFFER_SIZE];
+    TxState txState;
+    uint16_t txLength; // total length of the message which is sent
+    uint16_t txPosition; // number of bytes sent so far
+    uint8_t txSequence; // sequence number of the next consecutive frame
+    uint8_t txBlockSize; // block size requested by the receiver (0 = no more flow control)
+    uint8_t txBlockCounter; // consecutive frames left in the current block
+    uint32_t txSeparationTime; // minimum time between consecutive frames in microseconds (STmin)
+    uint32_t txTimestamp; // Clock::micros() of the last sent frame
+
+    void prepareFrame(CAN_FRAME *frame);
+    void sendConsecutiveFrame();
+    void sendFlowControl(FlowStatus status);
+    void handleFlowControl(CAN_FRAME *frame);
+    void handleFirstFrame(CAN_FRAME *frame);
+    void handleConsecutiveFrame(CAN_FRAME *frame);
+    void deliver(uint8_t *data, uint16_t length);
+    static uint32_t decodeSeparationTime(uint8_t stMin);
+};
+
+extern IsoTp isoTp;
+
+#endif /* ISOTP_H_ */
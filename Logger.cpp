@@ -31,6 +31,7 @@
 Logger::LogLevel Logger::logLevel = CFG_DEFAULT_LOGLEVEL;
 uint32_t Logger::lastLogTime = 0;
 bool Logger::debugging = false;
+bool Logger::muted = false;
 Logger::LogLevel *Logger::deviceLoglevel = new Logger::LogLevel[deviceIdsSize];
 char *Logger::msgBuffer = new char[CFG_LOG_BUFFER_SIZE];
 
@@ -169,6 +170,10 @@ void Logger::error(Device *device, char *message, ...)
  */
 void Logger::console(char *message, ...)
 {
+    if (muted) {
+        return;
+    }
+
     va_list args;
     va_start(args, message);
     vsnprintf(msgBuffer, CFG_LOG_BUFFER_SIZE, message, args);
@@ -250,6 +255,22 @@ boolean Logger::isDebug()
     return debugging;
 }
 
+/*
+ * Suppress all output (e.g. while the serial port is used for binary data).
+ */
+void Logger::setMuted(bool mute)
+{
+    muted = mute;
+}
+
+/*
+ * Is all output suppressed ?
+ */
+bool Logger::isMuted()
+{
+    return muted;
+}
+
 /*
  * Output a log message (called by debug(), info(), warn(), error(), console())
  *
@@ -258,7 +279,11 @@ boolean Logger::isDebug()
 void Logger::log(char *deviceName, LogLevel level, char *format, va_list args)
 {
     char *logLevel = "DEBUG";
-    lastLogTime = millis();
+
+    if (muted) {
+        return;
+    }
+    lastLogTime = Clock::millis();
 
     switch (level) {
         case Info:
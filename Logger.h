@@ -60,10 +60,13 @@ public:
     static LogLevel getLogLevel(Device *);
     static uint32_t getLastLogTime();
     static boolean isDebug();
+    static void setMuted(bool);
+    static bool isMuted();
 private:
     static LogLevel logLevel;
     static uint32_t lastLogTime;
     static bool debugging;
+    static bool muted;
     static LogLevel *deviceLoglevel;
     static char *msgBuffer;
 
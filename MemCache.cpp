@@ -30,6 +30,8 @@ MemCache memCache;
 
 MemCache::MemCache()
 {
+    flushPage = 0;
+    lastWriteTime = 0;
 }
 
 MemCache::~MemCache()
@@ -52,13 +54,13 @@ void MemCache::setup()
         pages[c].dirty = false;
     }
 
-    //WriteTimer = 0;
+    lastWriteTime = Clock::millis() - EEPROM_WRITE_TIME;
 
     //digital pin 18 is connected to the write protect function of the EEPROM. It is active high so set it low to enable writes
     pinMode(CFG_EEPROM_WRITE_PROTECT, OUTPUT);
     digitalWrite(CFG_EEPROM_WRITE_PROTECT, LOW);
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MEM_CACHE);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_MEM_CACHE, TickHandler::PRIORITY_HOUSEKEEPING);
 }
 
 /*
@@ -69,6 +71,10 @@ void MemCache::handleTick()
     U8 c;
     cache_age();
 
+    if (tickHandler.isCoroutineRunning(this) || isBusy()) { // FlushAllPages() is writing pages or the EEPROM is busy, retry with the next tick
+        return;
+    }
+
     for (c = 0; c < NUM_CACHED_PAGES; c++) {
         if ((pages[c].age == MAX_AGE) && (pages[c].dirty)) {
             FlushPage(c);
@@ -78,7 +84,15 @@ void MemCache::handleTick()
 }
 
 /*
- * Flush the first dirty page to the EEPROM.
+ * Name of the cache as shown in the tick statistics.
+ */
+char *MemCache::getCommonName()
+{
+    return "MemCache";
+}
+
+/*
+ * Flush the first dirty page to the EEPROM (waits for a running write cycle).
  */
 void MemCache::FlushSinglePage()
 {
@@ -96,26 +110,43 @@ void MemCache::FlushSinglePage()
 
 /*
  * Flush every dirty page.
- * It will block for 10ms per page so maybe things will be blocked for a long, long time
- *
- * NOTE: DO NOT USE THIS FUNCTION UNLESS YOU CAN ACCEPT THAT!
+ * The pages are written by a coroutine which waits for the write cycle of the EEPROM
+ * after each page without blocking the main loop, so the flushing will finish a while after this call returns.
  */
 void MemCache::FlushAllPages()
 {
-    U8 c;
+    tickHandler.startCoroutine(this);
+}
 
-    for (c = 0; c < NUM_CACHED_PAGES; c++) {
-        if (pages[c].dirty) { //found a dirty page so flush it
-            cache_writepage(c);
-            pages[c].dirty = false;
-            delay(10);  //10ms is longest it would take to write a page according to datasheet
+/*
+ * Write one dirty page after the other, each one as soon as the EEPROM finished
+ * the previous write cycle (see FlushAllPages()). Pages which become dirty while
+ * flushing are written too.
+ */
+bool MemCache::runCoroutine()
+{
+    COROUTINE_BEGIN();
+
+    while (true) {
+        for (flushPage = 0; flushPage < NUM_CACHED_PAGES && !pages[flushPage].dirty; flushPage++);
+
+        if (flushPage == NUM_CACHED_PAGES) {
+            break;
+        }
+        COROUTINE_WAIT_UNTIL(!isBusy());
+        if (pages[flushPage].dirty) {
+            cache_writepage(flushPage);
+            pages[flushPage].dirty = false;
         }
     }
+
+    COROUTINE_END();
 }
 
 /*
  * Flush a given page by the page ID.
  * This is NOT by address so act accordingly.
+ * Waits for a running write cycle of the EEPROM (see waitWriteCycle()).
  */
 void MemCache::FlushPage(uint8_t page)
 {
@@ -458,6 +489,7 @@ uint8_t MemCache::cache_findpage()
 
 /*
  * Find the page of the cache and read data directly from the EEPROM into it.
+ * Returns 0xFF if no page is available. Waits for a running write cycle of the EEPROM.
  */
 uint8_t MemCache::cache_readpage(uint32_t addr)
 {
@@ -465,9 +497,11 @@ uint8_t MemCache::cache_readpage(uint32_t addr)
     uint32_t address = addr << 8;
     uint8_t buffer[3];
     uint8_t i2c_id;
+
     c = cache_findpage();
 
     if (c != 0xFF) {
+        waitWriteCycle();
         buffer[0] = ((address & 0xFF00) >> 8);
         //buffer[1] = (address & 0x00FF);
         buffer[1] = 0; //the pages are 256 bytes so the start of a page is always 00 for the LSB
@@ -495,6 +529,7 @@ uint8_t MemCache::cache_readpage(uint32_t addr)
 
 /*
  * Write a page from the memory cache directly to the EEPROM
+ * Waits for a running write cycle of the EEPROM first.
  */
 boolean MemCache::cache_writepage(uint8_t page)
 {
@@ -502,6 +537,8 @@ boolean MemCache::cache_writepage(uint8_t page)
     uint32_t addr;
     uint8_t buffer[258];
     uint8_t i2c_id;
+
+    waitWriteCycle();
     addr = pages[page].address << 8;
     buffer[0] = ((addr & 0xFF00) >> 8);
     //buffer[1] = (addr & 0x00FF);
@@ -515,6 +552,30 @@ boolean MemCache::cache_writepage(uint8_t page)
     Wire.beginTransmission(i2c_id);
     Wire.write(buffer, 258);
     Wire.endTransmission(true);
-    
+    lastWriteTime = Clock::millis();
+
     return true;
 }
+
+/*
+ * Check if the EEPROM is still writing a page, it does not respond during the
+ * write cycle. The background flushing (aging in handleTick() and the coroutine of
+ * FlushAllPages()) only writes when the EEPROM is not busy, so it never waits.
+ */
+bool MemCache::isBusy()
+{
+    return Clock::millis() - lastWriteTime < EEPROM_WRITE_TIME;
+}
+
+/*
+ * Wait for the remainder of a running write cycle (at most EEPROM_WRITE_TIME).
+ * Only the synchronous Read()/Write() and flush calls of the users may wait here.
+ */
+void MemCache::waitWriteCycle()
+{
+    uint32_t elapsed = Clock::millis() - lastWriteTime;
+
+    if (elapsed < EEPROM_WRITE_TIME) {
+        Clock::delay(EEPROM_WRITE_TIME - elapsed);
+    }
+}
@@ -32,6 +32,7 @@
 #include <Arduino.h>
 #include "config.h"
 #include "TickHandler.h"
+#include "Coroutine.h"
 #include <due_wire.h>
 
 //Total # of allowable pages to cache. Limits RAM usage
@@ -39,6 +40,7 @@
 
 //maximum allowable age of a cache
 #define MAX_AGE  128
+#define EEPROM_WRITE_TIME 10 // ms the EEPROM needs to write a page (maximum according to the datasheet), it doesn't respond meanwhile
 
 /* # of system ticks per aging cycle. There are 128 aging levels total so
  // multiply 128 by this aging period and multiple that by system tick duration
@@ -50,11 +52,13 @@
  // each aging period below. Adjust accordingly.
  */
 
-class MemCache: public TickObserver
+class MemCache: public TickObserver, Coroutine
 {
 public:
     void setup();
     void handleTick();
+    char *getCommonName();
+    bool runCoroutine();
     void FlushSinglePage();
     void FlushAllPages();
     void FlushPage(uint8_t page);
@@ -64,6 +68,7 @@ public:
     void InvalidateAll();
     void AgeFullyPage(uint8_t page);
     void AgeFullyAddress(uint32_t address);
+    bool isBusy();
 
     boolean Write(uint32_t address, uint8_t valu);
     boolean Write(uint32_t address, uint16_t valu);
@@ -89,9 +94,12 @@ private:
     } PageCache;
 
     PageCache pages[NUM_CACHED_PAGES];
+    uint8_t flushPage; // page which is currently flushed by FlushAllPages()
+    uint32_t lastWriteTime; // time when the last page was sent to the EEPROM (millis)
     uint8_t cache_hit(uint32_t address);
     void cache_age();
     uint8_t cache_findpage();
+    void waitWriteCycle();
     uint8_t cache_readpage(uint32_t addr);
     boolean cache_writepage(uint8_t page);
 };
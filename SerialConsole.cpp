@@ -37,6 +37,9 @@ SerialConsole::SerialConsole()
 
 void SerialConsole::loop()
 {
+    if (canGateway.isActive()) { // the gateway reads the serial port itself
+        return;
+    }
     if (handlingEvent == false) {
         if (SerialUSB.available()) {
             serialEvent();
@@ -54,9 +57,27 @@ void SerialConsole::printMenu()
     Logger::console("Short Commands:");
     Logger::console("h = help (displays this message)");
     Logger::console("S = show list of devices");
+    Logger::console("T = show tick and message statistics (idle time, dispatch latency and execution time per observer, message queue)");
+    Logger::console("C = show CAN statistics (bus load, error counters, transmit queue)");
+    Logger::console("R = reset statistics");
+    Logger::console("0xE7 = enter GVRET binary mode, stream all CAN frames to SavvyCAN until the port is closed");
 
     Logger::console("\nConfig Commands (enter command=newvalue)\n");
     Logger::console("LOGLEVEL=%d - set log level (0=debug, 1=info, 2=warn, 3=error, 4=off)", Logger::getLogLevel());
+    Logger::console("TICK=<device id>,<interval> - set the tick interval of a device in microseconds (%d - %d)", CFG_TICK_INTERVAL_MIN,
+            CFG_TICK_INTERVAL_MAX);
+#ifdef CFG_SIMULATION
+    Logger::console("SIMULATE=<seconds> - run all tick observers on the virtual clock for the given time (1 - 604800)");
+#endif
+    Logger::console("CAPSTART=<id>[,<mask>[,<frames>]] - record CAN frames of both buses until <frames> after the trigger id (mask 0 = trigger immediately)");
+    Logger::console("CAPSTOP=1 - stop the CAN capture or replay");
+    Logger::console("CAPCLEAR=1 - discard the captured CAN frames");
+    Logger::console("CAPDUMP=<format> - print the captured CAN frames (0 = candump text, 1 = binary)");
+    Logger::console("CAPLOAD=<candump line> - append a frame in candump format to the capture buffer");
+    Logger::console("CAPREPLAY=<speed> - replay the received frames of the capture (1 = original timing, n = n times faster, 0 = no delay)");
+    Logger::console("ROUTE=<from>,<to>,<id>[,<mask>[,<interval>[,<target id>]]] - forward frames between buses (0 = EV, 1 = car, 2 = internal),");
+    Logger::console("      max one frame per interval (ms), the masked bits of the id are replaced by the target id, id's > 0x7ff are extended");
+    Logger::console("ROUTECLR=<bus> - remove all routes from a bus");
 
     deviceManager.printDeviceList();
 
@@ -149,6 +170,11 @@ void SerialConsole::serialEvent()
         return;
     }
 
+    if (incoming == GVRET_START_BINARY && ptrBuffer == 0) { // a GVRET client (e.g. SavvyCAN) connects
+        canGateway.start();
+        return;
+    }
+
     if (incoming == 10 || incoming == 13) { //command done. Parse it.
         handleConsoleCmd();
         ptrBuffer = 0; //reset line counter once the line has been processed
@@ -371,13 +397,12 @@ bool SerialConsole::handleConfigCmdFlowMeter(String command, long value)
 bool SerialConsole::handleConfigCmdSystem(String command, long value, char *parameter)
 {
 
-    if (command == String("ENABLE")) {
-        if (!deviceManager.sendMessage(DEVICE_ANY, (DeviceId) value, MSG_ENABLE, NULL)) {
-            Logger::console("Invalid device ID (%#x, %d)", value, value);
-        }
-    } else if (command == String("DISABLE")) {
-        if (!deviceManager.sendMessage(DEVICE_ANY, (DeviceId) value, MSG_DISABLE, NULL)) {
+    if (command == String("ENABLE") || command == String("DISABLE")) {
+        // the message is only queued, the device is enabled/disabled with the next loop
+        if (deviceManager.getDeviceByID((DeviceId) value) == NULL) {
             Logger::console("Invalid device ID (%#x, %d)", value, value);
+        } else if (!deviceManager.sendMessage(DEVICE_ANY, (DeviceId) value, command == String("ENABLE") ? MSG_ENABLE : MSG_DISABLE)) {
+            Logger::console("Unable to queue the message to device %#x", value);
         }
     } else if (command == String("LOGLEVEL")) {
         if (strchr(parameter, ',') == NULL) {
@@ -392,6 +417,61 @@ bool SerialConsole::handleConfigCmdSystem(String command, long value, char *para
             }
         }
         //TODO save log level to eeprom !
+    } else if (command == String("TICK")) {
+        if (strchr(parameter, ',') == NULL) {
+            Logger::console("Command needs a device id and an interval..ie TICK=0x5001,1000000\n");
+        } else {
+            DeviceId deviceId = (DeviceId) strtol(strtok(parameter, ","), NULL, 0);
+            Device *device = deviceManager.getDeviceByID(deviceId);
+            if (device != NULL && device->getConfiguration() != NULL) {
+                value = atol(strtok(NULL, ","));
+                device->setTickInterval(value);
+                device->saveConfiguration();
+            } else {
+                Logger::console("Invalid device ID (%#x, %d)", deviceId, deviceId);
+            }
+        }
+#ifdef CFG_SIMULATION
+    } else if (command == String("SIMULATE")) {
+        value = constrain(value, 1, 604800);
+        Logger::console("simulating %d seconds", value);
+        tickHandler.simulate(value * 1000);
+#endif
+    } else if (command == String("CAPSTART")) {
+        uint32_t id = strtoul(strtok(parameter, ","), NULL, 0);
+        char *mask = strtok(NULL, ",");
+        char *frames = strtok(NULL, ",");
+        canCapture.start(id, (mask ? strtoul(mask, NULL, 0) : CAN_CAPTURE_ID_MASK),
+                (frames ? constrain(atol(frames), 0, 0xffff) : CFG_CAN_CAPTURE_SIZE - 1));
+    } else if (command == String("CAPSTOP")) {
+        canCapture.stop();
+    } else if (command == String("CAPCLEAR")) {
+        canCapture.clear();
+    } else if (command == String("CAPDUMP")) {
+        canCapture.dump(value == 1 ? CanCapture::FORMAT_BINARY : CanCapture::FORMAT_CANDUMP);
+    } else if (command == String("CAPLOAD")) {
+        if (!canCapture.load(parameter)) {
+            Logger::console("Invalid frame, expected candump format..ie CAPLOAD=(1436509052.249713) can0 724#0011223344556677\n");
+        }
+    } else if (command == String("CAPREPLAY")) {
+        canCapture.replay(constrain(value, 0, 1000));
+    } else if (command == String("ROUTE")) {
+        char *from = strtok(parameter, ",");
+        char *to = strtok(NULL, ",");
+        char *id = strtok(NULL, ",");
+        if (id == NULL) {
+            Logger::console("Command needs at least a source, destination and id..ie ROUTE=0,1,0x724,0x7ff,100\n");
+        } else {
+            char *mask = strtok(NULL, ",");
+            char *interval = strtok(NULL, ",");
+            char *targetId = strtok(NULL, ",");
+            uint32_t canId = strtoul(id, NULL, 0);
+            bool extended = canId > 0x7ff;
+            CanHandler::getHandler(atol(from))->addRoute(CanHandler::getHandler(atol(to)), canId, (mask ? strtoul(mask, NULL, 0) : 0x1fffffff), extended,
+                    (interval ? atol(interval) : 0), (targetId ? strtoul(targetId, NULL, 0) : CAN_ROUTE_SAME_ID));
+        }
+    } else if (command == String("ROUTECLR")) {
+        CanHandler::getHandler(value)->clearRoutes();
     } else {
         return false;
     }
@@ -412,5 +492,27 @@ void SerialConsole::handleShortCmd()
     case 'S':
         deviceManager.printDeviceList();
         break;
+
+    case 'T':
+        tickHandler.printStatistics();
+        deviceManager.printStatistics();
+        break;
+
+    case 'C':
+        canHandlerEv.printStatistics();
+        canHandlerCar.printStatistics();
+        canHandlerInternal.printStatistics();
+        canCapture.printStatus();
+        canGateway.printStatistics();
+        udsServer.printStatistics();
+        break;
+
+    case 'R':
+        tickHandler.resetStatistics();
+        deviceManager.resetStatistics();
+        canHandlerEv.resetStatistics();
+        canHandlerCar.resetStatistics();
+        canHandlerInternal.resetStatistics();
+        break;
     }
 }
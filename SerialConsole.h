@@ -36,6 +36,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "EberspaecherHeater.h"
 #include "Temperature.h"
 #include "FlowMeter.h"
+#include "CanCapture.h"
+#include "CanGateway.h"
+#include "UdsServer.h"
 
 class SerialConsole
 {
@@ -52,7 +52,10 @@ Status::SystemState Status::getSystemState()
  * Set a new system state. The new system state is validated if the
  * transition is allowed from the old state. If an invalid transition is
  * attempted, the new state will be 'error'.
- * The old and new state are broadcast to all devices.
+ * The old and new state are broadcast to all devices. The message is queued, so the
+ * devices handle the transition (e.g. the tear down at shutdown) with the next
+ * DeviceManager::process(), not before this returns. Only a transition to 'error' is
+ * delivered immediately, it supersedes the transitions which are still queued.
  */
 Status::SystemState Status::setSystemState(SystemState newSystemState)
 {
@@ -121,7 +124,12 @@ Status::SystemState Status::setSystemState(SystemState newSystemState)
     }
 
     SystemState params[] = { oldSystemState, systemState };
-    deviceManager.sendMessage(DEVICE_ANY, INVALID, MSG_STATE_CHANGE, params);
+    if (systemState == error) { // safety: tear down the devices immediately
+        deviceManager.sendMessageSync(DEVICE_ANY, INVALID, MSG_STATE_CHANGE, params);
+    } else if (!deviceManager.sendMessage(DEVICE_ANY, INVALID, MSG_STATE_CHANGE, params, sizeof(params))) {
+        Logger::warn("message queue full, delivering the state change directly");
+        deviceManager.sendMessageSync(DEVICE_ANY, INVALID, MSG_STATE_CHANGE, params);
+    }
 
     return systemState;
 }
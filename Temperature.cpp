@@ -13,6 +13,7 @@ Temperature::Temperature() :
 {
     prefsHandler = new PrefHandler(TEMPERATURE);
     commonName = "TemperatureProbe";
+    defaultTickInterval = CFG_TICK_INTERVAL_TEMPERATURE;
 }
 
 /**
@@ -38,7 +39,24 @@ void Temperature::setup()
 
     ready = true;
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_TEMPERATURE);
+    canHandlerEv.prepareOutputFrame(&outputFrame.frame, CAN_ID_GEVCU_EXT_TEMPERATURE);
+    tickHandler.attach(this, getTickInterval(), TickHandler::PRIORITY_TELEMETRY);
+
+    for (uint16_t identifier = UDS_DID_TEMPERATURE_BATTERY_FRONT_UPPER; identifier <= UDS_DID_TEMPERATURE_EXTERIOR; identifier++) {
+        udsServer.attach(this, identifier);
+    }
+    udsServer.attach(this, UDS_DID_TEMPERATURE_MINIMUM);
+    udsServer.attach(this, UDS_DID_TEMPERATURE_MAXIMUM);
+}
+
+/**
+ * Tear down the device in a safe way.
+ */
+void Temperature::tearDown()
+{
+    Device::tearDown();
+    outputFrame.stop();
+    udsServer.detach(this);
 }
 
 
@@ -62,46 +80,97 @@ DeviceId Temperature::getId()
     return TEMPERATURE;
 }
 
+void Temperature::loadConfiguration()
+{
+    Device::loadConfiguration(); // call parent
+
+    if (!prefsHandler->checksumValid()) {
+        getConfiguration()->tickInterval = defaultTickInterval;
+        saveConfiguration();
+    }
+}
+
+void Temperature::saveConfiguration()
+{
+    Device::saveConfiguration(); // call parent
+
+    prefsHandler->saveChecksum();
+}
+
 /*
- * read temperatures and send them via CAN bus.
+ * read temperatures and update the CAN frame which is sent periodically.
+ * If a temperature changed by CFG_CAN_DEADBAND_TEMPERATURE or more since the last
+ * transmission, the frame is sent immediately.
  * The first 6 bytes are used for battery temperature. Byte 6 is the coolant temperature
  * and byte 7 is the exterior temperature.
  * All temperatures are added a offset of 50 degree celsius so a range of -50 to +204 fits into one ubyte
  */
 void Temperature::sendTemperature()
 {
-    canHandlerEv.prepareOutputFrame(&outputFrame, CAN_ID_GEVCU_EXT_TEMPERATURE);
+    BytesUnion data;
 
+    data.value = 0;
     for (int i = 0; i < CFG_MAX_NUM_TEMPERATURE_SENSORS && devices[i] != NULL; i++) {
         devices[i]->retrieveData();
         running = true;
         if (Logger::isDebug()) {
             Logger::debug(this, "sensor #%d: %f C", i, devices[i]->getTemperatureCelsius());
         }
+        publishSensor(i);
 
-        int byteNum = -1;
+        int16_t temperature = round(devices[i]->getTemperatureCelsius());
         if (!memcmp(devices[i]->getAddress(), addrBatteryFrontUpper, 8)) {
-            byteNum = 0;
+            TemperatureBatteryFrontUpperSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrBatteryFrontLower, 8)) {
-            byteNum = 1;
+            TemperatureBatteryFrontLowerSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrBatteryMid, 8)) {
-            byteNum = 2;
+            TemperatureBatteryMidSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrBatteryRearLeft, 8)) {
-            byteNum = 3;
+            TemperatureBatteryRearLeftSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrBatteryRearRight, 8)) {
-            byteNum = 4;
+            TemperatureBatteryRearRightSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrBatteryTrunk, 8)) {
-            byteNum = 5;
+            TemperatureBatteryTrunkSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrCoolant, 8)) {
-            byteNum = 6;
+            TemperatureCoolantSignal::encode(data, temperature);
         } else if (!memcmp(devices[i]->getAddress(), addrExterior, 8)) {
-            byteNum = 7;
+            TemperatureExteriorSignal::encode(data, temperature);
         }
-        if (byteNum != -1) {
-            outputFrame.data.byte[byteNum] = constrain(round(devices[i]->getTemperatureCelsius()) + CFG_CAN_TEMPERATURE_OFFSET, 0, 255);
+    }
+
+    // the frame is sent from the timer interrupt, don't let it see a half updated payload
+    BytesUnion sent;
+    noInterrupts();
+    outputFrame.frame.data.value = data.value;
+    sent.value = outputFrame.sentData.value;
+    interrupts();
+
+    if (!outputFrame.isActive()) {
+        outputFrame.setInhibitTime(CFG_CAN_INHIBIT_TEMPERATURE);
+        outputFrame.start(&canHandlerEv, CFG_CAN_CYCLE_TEMPERATURE, TickHandler::PHASE_AUTO, CanHandler::TX_PRIORITY_TELEMETRY);
+        outputFrame.trigger();
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (abs(data.bytes[i] - sent.bytes[i]) >= CFG_CAN_DEADBAND_TEMPERATURE) {
+            outputFrame.trigger();
+            break;
         }
     }
-    canHandlerEv.sendFrame(outputFrame);
+}
+
+/*
+ * Publish the temperature of a sensor on the internal bus, so other devices
+ * can subscribe to the sensors they need (identified by the serial number).
+ */
+void Temperature::publishSensor(uint8_t number)
+{
+    CAN_FRAME frame;
+
+    canHandlerInternal.prepareOutputFrame(&frame, CAN_ID_INTERNAL_TEMPERATURE + number);
+    InternalTemperatureSignal::encode(frame.data, round(devices[number]->getTemperatureCelsius() * 10));
+    memcpy(frame.data.bytes + 2, devices[number]->getAddress() + 1, 6);
+    canHandlerInternal.sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY);
 }
 
 /*
@@ -149,3 +218,52 @@ float Temperature::getSensorTemperature(byte *address) {
     }
     return 999;
 }
+
+/*
+ * Provide a temperature in 0.1 degree celsius for a UDS ReadDataByIdentifier request.
+ */
+uint16_t Temperature::readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength)
+{
+    float temperature;
+
+    switch (identifier) {
+    case UDS_DID_TEMPERATURE_BATTERY_FRONT_UPPER:
+        temperature = getSensorTemperature(addrBatteryFrontUpper);
+        break;
+    case UDS_DID_TEMPERATURE_BATTERY_FRONT_LOWER:
+        temperature = getSensorTemperature(addrBatteryFrontLower);
+        break;
+    case UDS_DID_TEMPERATURE_BATTERY_MID:
+        temperature = getSensorTemperature(addrBatteryMid);
+        break;
+    case UDS_DID_TEMPERATURE_BATTERY_REAR_LEFT:
+        temperature = getSensorTemperature(addrBatteryRearLeft);
+        break;
+    case UDS_DID_TEMPERATURE_BATTERY_REAR_RIGHT:
+        temperature = getSensorTemperature(addrBatteryRearRight);
+        break;
+    case UDS_DID_TEMPERATURE_BATTERY_TRUNK:
+        temperature = getSensorTemperature(addrBatteryTrunk);
+        break;
+    case UDS_DID_TEMPERATURE_COOLANT:
+        temperature = getSensorTemperature(addrCoolant);
+        break;
+    case UDS_DID_TEMPERATURE_EXTERIOR:
+        temperature = getSensorTemperature(addrExterior);
+        break;
+    case UDS_DID_TEMPERATURE_MINIMUM:
+        temperature = getMinimum();
+        break;
+    case UDS_DID_TEMPERATURE_MAXIMUM:
+        temperature = getMaximum();
+        break;
+    default:
+        return 0;
+    }
+
+    if (temperature >= 999 || temperature <= -999 || !running) { // sensor not found or no value yet
+        return 0;
+    }
+    UdsServer::putUInt16(data, (int16_t) round(temperature * 10));
+    return 2;
+}
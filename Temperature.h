@@ -11,26 +11,49 @@
 #include "TickHandler.h"
 #include "DeviceManager.h"
 #include "CanHandler.h"
+#include "CanCyclicFrame.h"
+#include "CanSignal.h"
+#include "UdsServer.h"
 #include "TemperatureSensor.h"
 
 #define CAN_ID_GEVCU_EXT_TEMPERATURE     0x728 // Temperature CAN message
 
-class Temperature: public Device
+// signals of the temperature frame in degree celsius (transmitted with an offset to fit -50 to +205 into one byte)
+#define TEMPERATURE_SIGNAL(byteNum) CanSignal<(byteNum) * 8, 8, CAN_INTEL, CAN_UNSIGNED, int16_t, 1, 1, -CFG_CAN_TEMPERATURE_OFFSET>
+typedef TEMPERATURE_SIGNAL(0) TemperatureBatteryFrontUpperSignal;
+typedef TEMPERATURE_SIGNAL(1) TemperatureBatteryFrontLowerSignal;
+typedef TEMPERATURE_SIGNAL(2) TemperatureBatteryMidSignal;
+typedef TEMPERATURE_SIGNAL(3) TemperatureBatteryRearLeftSignal;
+typedef TEMPERATURE_SIGNAL(4) TemperatureBatteryRearRightSignal;
+typedef TEMPERATURE_SIGNAL(5) TemperatureBatteryTrunkSignal;
+typedef TEMPERATURE_SIGNAL(6) TemperatureCoolantSignal;
+typedef TEMPERATURE_SIGNAL(7) TemperatureExteriorSignal;
+
+// frames on the internal bus, one per sensor: temperature (2 bytes) and the serial number of the sensor (address bytes 1-6)
+#define CAN_ID_INTERNAL_TEMPERATURE     0x200 // + number of the sensor (0 - 31)
+#define CAN_MASK_INTERNAL_TEMPERATURE   0x7e0 // mask to subscribe to the frames of all sensors
+typedef CanSignal<0, 16, CAN_INTEL, CAN_SIGNED, int16_t> InternalTemperatureSignal; // temperature in 0.1 degree celsius
+
+class Temperature: public Device, UdsObserver
 {
 public:
     Temperature();
     void setup();
+    void tearDown();
     void handleTick();
     DeviceId getId();
     DeviceType getType();
+    void loadConfiguration();
+    void saveConfiguration();
     float getMinimum();
     float getMaximum();
     float getSensorTemperature(byte[]);
+    uint16_t readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength);
 
 protected:
 
 private:
-    CAN_FRAME outputFrame; // the output CAN frame;
+    CanCyclicFrame outputFrame; // the output CAN frame, sent periodically once the first temperatures are available
     TemperatureSensor *devices[CFG_MAX_NUM_TEMPERATURE_SENSORS];
 
     // The following are addresses of temperature sensors, adapt them for your own
@@ -44,6 +67,7 @@ private:
     byte addrExterior[8] = { 0x28, 0xFF, 0xDE, 0x26, 0xA8, 0x15, 0x04, 0x6C };
 
     void sendTemperature();
+    void publishSensor(uint8_t number);
 };
 
 #endif /* TEMPERATURE_H_ */
@@ -3,10 +3,25 @@
  *
  * Class to which TickObserver objects can register to be triggered
  * on a certain interval.
- * TickObserver with the same interval are grouped to the same timer
- * and triggered in sequence per timer interrupt.
- *
- * NOTE: The initialize() method must be called before a observer is registered !
+ * All observers are driven by one single hardware timer. Each observer entry
+ * holds the absolute time of its next tick (deadline) and the entries are kept
+ * in a min-heap ordered by deadline. On every timer interrupt the due entries are
+ * queued and their deadline is advanced by their interval, so no drift accumulates.
+ * The timer is used as one-shot timer which is always programmed to the earliest
+ * deadline of the heap, so there is exactly one interrupt per distinct deadline,
+ * independent of how the intervals and phases relate to each other.
+ * The queued ticks are handed from the interrupt to process() via a lock-free
+ * single-producer/single-consumer ring. With CFG_TIMER_COALESCE_TICKS an entry is
+ * queued at most once, repeated ticks are counted as missed ticks instead.
+ * Observers sharing the same interval are phase-shifted against each other (evenly
+ * spread or by an explicit phase) so their work and bus traffic is not bursty.
+ * Each priority class has its own ring and process() always dispatches the highest
+ * class first, so safety checks don't wait behind long running telemetry observers.
+ * Observers of PRIORITY_INTERRUPT are not queued but called in the timer interrupt
+ * for short jobs which need low jitter (e.g. cyclic CAN frames).
+ * Running coroutines (see Coroutine.h) are resumed on every call of process().
+ * For every entry the dispatch latency (interrupt to handleTick()) and the execution
+ * time of handleTick() are collected to find observers which starve others.
  *
  Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
@@ -37,255 +52,884 @@ TickHandler tickHandler;
 
 TickHandler::TickHandler()
 {
-    for (int i = 0; i < NUM_TIMERS; i++) {
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
         timerEntry[i].interval = 0;
-
-        for (int j = 0; j < CFG_TIMER_NUM_OBSERVERS; j++) {
-            timerEntry[i].observer[j] = NULL;
-        }
+        timerEntry[i].deadline = 0;
+        timerEntry[i].phase = 0;
+        timerEntry[i].autoPhase = false;
+        timerEntry[i].realign = false;
+        timerEntry[i].heapIndex = 0;
+        timerEntry[i].priority = PRIORITY_CONTROL;
+        timerEntry[i].pending = false;
+        timerEntry[i].missedTicks = 0;
+        timerEntry[i].observer = NULL;
+        clearStatistics(&timerEntry[i].statistics);
+    }
+    scheduleSize = 0;
+    currentTime = 0;
+    timerDeadline = 0;
+    timerRunning = false;
+    interruptCount = 0;
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        bufferHead[i] = bufferTail[i] = 0;
+    }
+    overflowCount = 0;
+    dispatchMissedTicks = 0;
+    idleTime = 0;
+    statisticsStart = 0;
+    for (int i = 0; i < CFG_TIMER_NUM_COROUTINES; i++) {
+        coroutines[i] = NULL;
     }
-    bufferHead = bufferTail = 0;
 }
 
 /**
  * Register an observer to be triggered in a certain interval.
- * TickObservers with the same interval are grouped to one timer to save timers.
  * A TickObserver may be registered multiple times with different intervals.
+ * The priority class determines the order in which queued ticks are dispatched.
+ * The phase defines the offset of the ticks within the interval. With PHASE_AUTO
+ * the observer is placed in the middle of the largest gap between the phases of
+ * the auto-phased observers with the same interval (the others keep their phase).
  *
- * First a timer with the same interval is looked up. If none found, a free one is
- * used. Then a free TickObserver slot (of max CFG_MAX_TICK_OBSERVERS) is looked up. If all went
- * well, the timer is configured and (re)started.
+ * A free entry (of max CFG_TIMER_NUM_OBSERVERS) is looked up, its first deadline is
+ * calculated and it is added to the schedule. If it is the earliest deadline, the
+ * hardware timer is re-programmed.
  */
-void TickHandler::attach(TickObserver* observer, uint32_t interval)
+void TickHandler::attach(TickObserver* observer, uint32_t interval, TickPriority priority, uint32_t phase)
 {
     if (isAttached(observer, interval)) {
         Logger::warn("TickObserver %#x is already attached with interval %d", observer, interval);
         return;
     }
 
-    int timer = findTimer(interval);
+    if (interval == 0) {
+        Logger::error("invalid interval 0 for TickObserver %#x", observer);
+        return;
+    }
+
+    int entry = findEntry(NULL, 0);
 
-    if (timer == -1) {
-        timer = findTimer(0);   // no timer with given tick interval exist -> look for unused (interval == 0)
+    if (entry == -1) {
+        Logger::error("No free observer slot for interval %d, increase CFG_TIMER_NUM_OBSERVERS", interval);
+        return;
+    }
+
+    noInterrupts();
+    updateTime();
+    timerEntry[entry].interval = interval;
+    timerEntry[entry].autoPhase = (phase == PHASE_AUTO);
+    timerEntry[entry].realign = false;
+    timerEntry[entry].priority = priority;
+    timerEntry[entry].pending = false;
+    timerEntry[entry].missedTicks = 0;
+    timerEntry[entry].observer = observer;
+    clearStatistics(&timerEntry[entry].statistics);
+    if (timerEntry[entry].autoPhase) {
+        placePhase(entry);
+    } else {
+        setPhase(entry, phase % interval);
+    }
+    insertSchedule(entry);
+    interrupts();
+
+    updateTimer();
+    Logger::debug("attached TickObserver (%#x) as number %d, %dus interval, priority %d, phase %dus", observer, entry, interval, priority,
+            timerEntry[entry].phase);
+}
+
+/*
+ * Check if a observer is attached to this handler.
+ *
+ * \param observer - observer object to search
+ * \param interval - interval of the observer to search
+ */
+bool TickHandler::isAttached(TickObserver* observer, uint32_t interval)
+{
+    return findEntry(observer, interval) != -1;
+}
 
-        if (timer == -1) {
-            Logger::error("No free timer available for interval=%d", interval);
-            return;
+/**
+ * Remove an observer from all entries where it was registered.
+ */
+void TickHandler::detach(TickObserver* observer)
+{
+    bool removed = false;
+
+    for (int entry = 0; entry < CFG_TIMER_NUM_OBSERVERS; entry++) {
+        if (timerEntry[entry].observer == observer) {
+            Logger::debug("removing TickObserver (%#x) as number %d", observer, entry);
+            noInterrupts();
+            removeSchedule(entry);
+            timerEntry[entry].observer = NULL;
+            timerEntry[entry].interval = 0;
+            interrupts();
+            removed = true;
         }
+    }
 
-        timerEntry[timer].interval = interval;
+    if (removed) {
+        updateTimer();
     }
+}
 
-    int observerIndex = findObserver(timer, 0);
+/**
+ * Change the interval of all entries of an observer at runtime.
+ * The priority and a fixed phase are kept (the phase is limited to the new interval),
+ * auto-phased entries are placed in the largest gap of the new interval. The next
+ * tick is scheduled relative to the current time according to the new interval.
+ */
+void TickHandler::setInterval(TickObserver* observer, uint32_t interval)
+{
+    bool changed = false;
 
-    if (observerIndex == -1) {
-        Logger::error("No free observer slot for timer %d with interval %d", timer, timerEntry[timer].interval);
+    if (interval == 0) {
+        Logger::error("invalid interval 0 for TickObserver %#x", observer);
         return;
     }
 
-    timerEntry[timer].observer[observerIndex] = observer;
-    Logger::debug("attached TickObserver (%#x) as number %d to timer %d, %dus interval", observer, observerIndex, timer, interval);
+    for (int entry = 0; entry < CFG_TIMER_NUM_OBSERVERS; entry++) {
+        TimerEntry *timer = &timerEntry[entry];
 
-    switch (timer) { // restarting a timer which would already be running is no problem (see DueTimer.cpp)
-        case 0:
-            Timer0.setPeriod(interval).attachInterrupt(timer0Interrupt).start();
-            break;
+        if (timer->observer != observer || timer->interval == interval) {
+            continue;
+        }
 
-        case 1:
-            Timer1.setPeriod(interval).attachInterrupt(timer1Interrupt).start();
-            break;
+        uint32_t oldInterval = timer->interval;
+        noInterrupts();
+        updateTime();
+        timer->interval = interval;
+        if (timer->autoPhase) {
+            placePhase(entry);
+        } else {
+            setPhase(entry, timer->phase % interval);
+        }
+        siftDown(timer->heapIndex);
+        siftUp(timer->heapIndex);
+        interrupts();
+        changed = true;
+        Logger::debug("TickObserver (%#x) number %d changed from %dus to %dus interval", observer, entry, oldInterval, interval);
+    }
 
-        case 2:
-            Timer2.setPeriod(interval).attachInterrupt(timer2Interrupt).start();
-            break;
+    if (changed) {
+        updateTimer();
+    }
+}
 
-        case 3:
-            Timer3.setPeriod(interval).attachInterrupt(timer3Interrupt).start();
-            break;
+/*
+ * Move the next tick of all entries of an observer to the given delay (microseconds)
+ * from now, the following ticks return to the phase of the entry. If align is set, the
+ * next tick is the first one in the phase of the entry after the delay instead.
+ * May be called from the interrupt or within a critical section, the interrupt
+ * state is restored.
+ */
+void TickHandler::reschedule(TickObserver* observer, uint32_t delay, bool align)
+{
+    uint32_t primask = enterCritical();
+    updateTime();
+    for (int entry = 0; entry < CFG_TIMER_NUM_OBSERVERS; entry++) {
+        TimerEntry *timer = &timerEntry[entry];
+
+        if (timer->observer == observer) {
+            if (align) {
+                alignDeadline(entry, currentTime + delay);
+                timer->realign = false;
+            } else {
+                // at least 1us, so a tick in the interrupt isn't queued again by the running queueDueTicks()
+                timer->deadline = currentTime + max(delay, 1);
+                timer->realign = true;
+            }
+            siftDown(timer->heapIndex);
+            siftUp(timer->heapIndex);
+        }
+    }
+    updateTimer();
+    leaveCritical(primask);
+}
 
-        case 4:
-            Timer4.setPeriod(interval).attachInterrupt(timer4Interrupt).start();
-            break;
+/*
+ * Find the entry of an observer with a specific interval.
+ * If observer is NULL, the first unused entry is returned.
+ */
+int TickHandler::findEntry(TickObserver *observer, uint32_t interval)
+{
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
+        if (timerEntry[i].observer == observer && (observer == NULL || timerEntry[i].interval == interval)) {
+            return i;
+        }
+    }
 
-        case 5:
-            Timer5.setPeriod(interval).attachInterrupt(timer5Interrupt).start();
-            break;
+    return -1;
+}
 
-        case 6:
-            Timer6.setPeriod(interval).attachInterrupt(timer6Interrupt).start();
-            break;
+/*
+ * Compare the deadlines of two entries, taking an overflow of the scheduler time into account.
+ */
+bool TickHandler::isEarlier(uint8_t entryA, uint8_t entryB)
+{
+    return (int32_t) (timerEntry[entryA].deadline - timerEntry[entryB].deadline) < 0;
+}
+
+/*
+ * Swap two positions of the schedule heap and keep the back-references of the entries up to date.
+ */
+void TickHandler::swapHeap(uint8_t posA, uint8_t posB)
+{
+    uint8_t entry = schedule[posA];
 
-        case 7:
-            Timer7.setPeriod(interval).attachInterrupt(timer7Interrupt).start();
+    schedule[posA] = schedule[posB];
+    schedule[posB] = entry;
+    timerEntry[schedule[posA]].heapIndex = posA;
+    timerEntry[schedule[posB]].heapIndex = posB;
+}
+
+/*
+ * Move an entry towards the top of the heap until its parent is not later than itself.
+ */
+void TickHandler::siftUp(uint8_t pos)
+{
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+
+        if (!isEarlier(schedule[pos], schedule[parent])) {
             break;
+        }
+        swapHeap(pos, parent);
+        pos = parent;
+    }
+}
 
-        case 8:
-            Timer8.setPeriod(interval).attachInterrupt(timer8Interrupt).start();
+/*
+ * Move an entry towards the bottom of the heap until no child is earlier than itself.
+ */
+void TickHandler::siftDown(uint8_t pos)
+{
+    while (true) {
+        uint8_t earliest = pos;
+        uint8_t left = 2 * pos + 1;
+        uint8_t right = left + 1;
+
+        if (left < scheduleSize && isEarlier(schedule[left], schedule[earliest])) {
+            earliest = left;
+        }
+        if (right < scheduleSize && isEarlier(schedule[right], schedule[earliest])) {
+            earliest = right;
+        }
+        if (earliest == pos) {
             break;
+        }
+        swapHeap(pos, earliest);
+        pos = earliest;
     }
 }
 
 /*
- * Check if a observer is attached to this handler.
- *
- * \param observer - observer object to search
- * \param interval - interval of the observer to search
+ * Add an entry to the schedule heap (interrupts must be disabled).
  */
-bool TickHandler::isAttached(TickObserver* observer, uint32_t interval)
+void TickHandler::insertSchedule(uint8_t entry)
+{
+    schedule[scheduleSize] = entry;
+    timerEntry[entry].heapIndex = scheduleSize;
+    scheduleSize++;
+    siftUp(scheduleSize - 1);
+}
+
+/*
+ * Remove an entry from the schedule heap (interrupts must be disabled).
+ */
+void TickHandler::removeSchedule(uint8_t entry)
+{
+    uint8_t pos = timerEntry[entry].heapIndex;
+
+    scheduleSize--;
+    if (pos != scheduleSize) {
+        swapHeap(pos, scheduleSize);
+        siftDown(pos);
+        siftUp(pos);
+    }
+}
+
+/*
+ * Set the phase of an entry and calculate its next deadline: the first point in time
+ * after the current scheduler time which is a multiple of the interval plus the phase
+ * (interrupts must be disabled).
+ */
+void TickHandler::setPhase(uint8_t entry, uint32_t phase)
 {
-    for (int timer = 0; timer < NUM_TIMERS; timer++) {
-        for (int observerIndex = 0; observerIndex < CFG_TIMER_NUM_OBSERVERS; observerIndex++) {
-            if (timerEntry[timer].observer[observerIndex] == observer &&
-                    timerEntry[timer].interval == interval) {
-                return true;
+    timerEntry[entry].phase = phase;
+    alignDeadline(entry, currentTime);
+}
+
+/*
+ * Set the deadline of an entry to the first point in time after the given time which
+ * is a multiple of the interval plus the phase (interrupts must be disabled).
+ */
+void TickHandler::alignDeadline(uint8_t entry, uint32_t time)
+{
+    TimerEntry *timer = &timerEntry[entry];
+
+    timer->deadline = time - (time % timer->interval) + timer->phase;
+    if ((int32_t) (timer->deadline - time) <= 0) {
+        timer->deadline += timer->interval;
+    }
+}
+
+/*
+ * Set the phase of an auto-phased entry to the middle of the largest gap between the
+ * phases of the other auto-phased entries with the same interval (0 if there is none).
+ * The other entries are not touched, so their pending ticks and reschedules remain
+ * valid. Entries which are attached one after the other are spread evenly if there
+ * are 2^n of them, otherwise the largest gap is at most twice the smallest one
+ * (interrupts must be disabled).
+ */
+void TickHandler::placePhase(uint8_t entry)
+{
+    uint32_t interval = timerEntry[entry].interval;
+    uint32_t phases[CFG_TIMER_NUM_OBSERVERS];
+    uint8_t count = 0;
+
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
+        if (i != entry && timerEntry[i].observer != NULL && timerEntry[i].autoPhase && timerEntry[i].interval == interval) {
+            uint8_t pos = count++;
+
+            // insertion sort, the list is short
+            while (pos > 0 && phases[pos - 1] > timerEntry[i].phase) {
+                phases[pos] = phases[pos - 1];
+                pos--;
             }
+            phases[pos] = timerEntry[i].phase;
+        }
+    }
+
+    if (count == 0) {
+        setPhase(entry, 0);
+        return;
+    }
+
+    uint32_t gapStart = phases[count - 1], gap = phases[0] + interval - phases[count - 1]; // the gap across the end of the interval
+    for (int i = 1; i < count; i++) {
+        if (phases[i] - phases[i - 1] > gap) {
+            gapStart = phases[i - 1];
+            gap = phases[i] - phases[i - 1];
         }
     }
-    return false;
+    setPhase(entry, (gapStart + gap / 2) % interval);
 }
 
-/**
- * Remove an observer from all timers where it was registered.
+/*
+ * Move the scheduler time forward to the current time. Between two interrupts the
+ * scheduler time stands still, so it is updated before new deadlines are calculated
+ * relative to it. It never moves backwards, the interrupt may have set it a few
+ * microseconds ahead (interrupts must be disabled).
  */
-void TickHandler::detach(TickObserver* observer)
+void TickHandler::updateTime()
 {
-    for (int timer = 0; timer < NUM_TIMERS; timer++) {
-        for (int observerIndex = 0; observerIndex < CFG_TIMER_NUM_OBSERVERS; observerIndex++) {
-            if (timerEntry[timer].observer[observerIndex] == observer) {
-                Logger::debug("removing TickObserver (%#x) as number %d from timer %d", observer, observerIndex, timer);
-                timerEntry[timer].observer[observerIndex] = NULL;
+    uint32_t now = Clock::micros();
+
+    if ((int32_t) (now - currentTime) > 0) {
+        currentTime = now;
+    }
+}
+
+/*
+ * Program the hardware timer as one-shot timer to the earliest deadline of the schedule.
+ * The timer is only re-programmed if the earliest deadline changed. Deadlines which
+ * are less than CFG_TIMER_MIN_DELAY ahead (or already passed) are triggered after
+ * the minimum delay. The timer is stopped if no observer is attached. Interrupts may
+ * be enabled, the interrupt state is restored.
+ */
+void TickHandler::updateTimer()
+{
+    uint32_t primask = enterCritical();
+
+    if (scheduleSize == 0) {
+        if (timerRunning) {
+            timerRunning = false;
+#ifndef CFG_SIMULATION
+            Timer0.stop();
+#endif
+        }
+    } else {
+        uint32_t deadline = timerEntry[schedule[0]].deadline;
+
+        if (!timerRunning || deadline != timerDeadline) {
+            int32_t delay = deadline - Clock::micros();
+
+            if (delay < CFG_TIMER_MIN_DELAY) {
+                delay = CFG_TIMER_MIN_DELAY;
             }
+            timerDeadline = deadline;
+#ifndef CFG_SIMULATION
+            if (!timerRunning) {
+                Timer0.attachInterrupt(timerInterrupt);
+            }
+            // DueTimer runs periodically, but every interrupt re-programs it to the next deadline
+            // (setting the period and starting the timer again restarts the counter, see DueTimer.cpp)
+            Timer0.setPeriod(delay).start();
+#endif
+            timerRunning = true;
         }
     }
+    leaveCritical(primask);
 }
 
-/**
- * Find a timer with a specified interval.
+/*
+ * Check if a tick is available, forward it to registered observers.
+ * The queue of the highest priority class which contains a tick is always served
+ * first. Telemetry and housekeeping ticks are only dispatched until
+ * CFG_TIMER_LOW_PRIORITY_BUDGET microseconds have passed in this call (but at
+ * least one per call), the rest remains queued for the next loop.
  */
-int TickHandler::findTimer(long interval)
+void TickHandler::process()
 {
-    for (int i = 0; i < NUM_TIMERS; i++) {
-        if (timerEntry[i].interval == interval) {
-            return i;
+    uint32_t start = Clock::wallMicros();
+    bool lowPriorityDispatched = false;
+
+    while (true) {
+        int priority = 0;
+
+        while (priority < NUM_PRIORITIES && bufferHead[priority] == bufferTail[priority]) {
+            priority++;
+        }
+        if (priority == NUM_PRIORITIES) {
+            break;
+        }
+
+        if (priority >= PRIORITY_TELEMETRY) {
+#if CFG_TIMER_LOW_PRIORITY_BUDGET > 0
+            if (lowPriorityDispatched && Clock::wallMicros() - start > CFG_TIMER_LOW_PRIORITY_BUDGET) {
+                break;
+            }
+#endif
+            lowPriorityDispatched = true;
         }
+        dispatch((TickPriority) priority);
     }
+    dispatchMissedTicks = 0;
 
-    return -1;
+    resumeCoroutines();
 }
 
 /*
- * Find a TickObserver in the list of a specific timer.
+ * Check if no tick is queued and no coroutine is running. Must be called with
+ * interrupts disabled if the result is used to decide to sleep().
+ * A running coroutine may wait for a point in time (e.g. COROUTINE_DELAY()) which
+ * is not signalled by an interrupt, so the core must not sleep while one is running.
  */
-int TickHandler::findObserver(int timer, TickObserver *observer)
+bool TickHandler::isIdle()
 {
-    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
-        if (timerEntry[timer].observer[i] == observer) {
-            return i;
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        if (bufferHead[i] != bufferTail[i]) {
+            return false;
+        }
+    }
+    for (int i = 0; i < CFG_TIMER_NUM_COROUTINES; i++) {
+        if (coroutines[i] != NULL) {
+            return false;
         }
     }
+    return true;
+}
 
-    return -1;
+/*
+ * Put the CPU to sleep until the next interrupt (timer, CAN, USB) occurs.
+ * Must be called with interrupts disabled after it was verified that no work
+ * is pending, otherwise an interrupt between the check and the sleep would be
+ * missed. A pending interrupt still wakes up the core, its handler runs as soon
+ * as interrupts are enabled again. The time spent sleeping is accumulated as
+ * idle time (see printStatistics()).
+ */
+void TickHandler::sleep()
+{
+    uint32_t start = Clock::wallMicros();
+#ifndef CFG_SIMULATION
+    __WFI();
+#endif
+    idleTime += Clock::wallMicros() - start;
 }
 
 /*
- * Check if a tick is available, forward it to registered observers.
+ * Take the next tick from the queue of a priority class and forward it to the observer.
+ * The pending flag of the entry is cleared before the observer is called,
+ * so a tick which occurs during handleTick() is queued again.
  */
-void TickHandler::process()
+void TickHandler::dispatch(TickPriority priority)
 {
-    while (bufferHead != bufferTail) {
-        if (tickBuffer[bufferTail] == NULL) {
-            Logger::error("tickBuffer pointer mismatch");
-        } else {
-//            Logger::debug("tickHandler->process, bufferHead=%d bufferTail=%d", bufferHead, bufferTail);
-            tickBuffer[bufferTail]->handleTick();
-            tickBuffer[bufferTail] = NULL;
+    uint16_t tail = bufferTail[priority];
+    TimerEntry *entry = &timerEntry[tickBuffer[priority][tail].entry];
+    uint32_t timestamp = tickBuffer[priority][tail].timestamp;
+    uint32_t time = tickBuffer[priority][tail].time;
+    bufferTail[priority] = (tail + 1) % CFG_TIMER_BUFFER_SIZE;
+
+    noInterrupts();
+    dispatchMissedTicks = entry->missedTicks;
+    entry->missedTicks = 0;
+    entry->pending = false;
+    interrupts();
+
+    if (entry->observer != NULL) { // the observer might have been detached in the meantime
+//        Logger::debug("tickHandler->process, priority=%d bufferHead=%d bufferTail=%d", priority, bufferHead[priority], bufferTail[priority]);
+        uint32_t start = Clock::wallMicros();
+        uint32_t latency = Clock::micros() - timestamp;
+        entry->observer->handleTick();
+        uint32_t end = Clock::wallMicros();
+        entry->statistics.lastTime = time;
+        updateStatistics(&entry->statistics, latency, end - start);
+    }
+}
+
+/*
+ * Resume all running coroutines once. Coroutines which finished are removed.
+ */
+void TickHandler::resumeCoroutines()
+{
+    for (int i = 0; i < CFG_TIMER_NUM_COROUTINES; i++) {
+        if (coroutines[i] != NULL && !coroutines[i]->runCoroutine()) {
+            coroutines[i] = NULL;
         }
-        bufferTail = (bufferTail + 1) % CFG_TIMER_BUFFER_SIZE;
     }
 }
 
-void TickHandler::cleanBuffer()
+/*
+ * Start a coroutine from the beginning. It is resumed on every process() until it finishes.
+ * If the coroutine is already running, it continues where it is.
+ */
+void TickHandler::startCoroutine(Coroutine *coroutine)
 {
-    bufferHead = bufferTail = 0;
+    if (findCoroutine(coroutine) != -1) {
+        return;
+    }
+
+    int i = findCoroutine(NULL);
+
+    if (i == -1) {
+        Logger::error("No free coroutine slot, increase CFG_TIMER_NUM_COROUTINES");
+        return;
+    }
+    coroutine->resetCoroutine();
+    coroutines[i] = coroutine;
+}
+
+/*
+ * Stop a running coroutine, it won't be resumed anymore.
+ */
+void TickHandler::stopCoroutine(Coroutine *coroutine)
+{
+    int i = findCoroutine(coroutine);
+
+    if (i != -1) {
+        coroutines[i] = NULL;
+    }
+}
+
+/*
+ * Check if a coroutine is started and not finished yet.
+ */
+bool TickHandler::isCoroutineRunning(Coroutine *coroutine)
+{
+    return findCoroutine(coroutine) != -1;
 }
 
 /*
- * Handle the interrupt of any timer.
- * All the registered TickObservers of the timer are called.
+ * Find the slot of a coroutine. If coroutine is NULL, the first free slot is returned.
  */
-void TickHandler::handleInterrupt(int timerNumber)
+int TickHandler::findCoroutine(Coroutine *coroutine)
 {
+    for (int i = 0; i < CFG_TIMER_NUM_COROUTINES; i++) {
+        if (coroutines[i] == coroutine) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Discard all queued ticks.
+ */
+void TickHandler::cleanBuffer()
+{
+    noInterrupts();
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        bufferHead[i] = bufferTail[i] = 0;
+    }
     for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
-        if (timerEntry[timerNumber].observer[i] != NULL) {
-            tickBuffer[bufferHead] = timerEntry[timerNumber].observer[i];
-            bufferHead = (bufferHead + 1) % CFG_TIMER_BUFFER_SIZE;
-//            Logger::debug("tickHandler->handle bufferHead=%d, bufferTail=%d, observer=%d", bufferHead, bufferTail, timerEntry[timerNumber].observer[i]);
+        timerEntry[i].pending = false;
+    }
+    interrupts();
+}
+
+/*
+ * Get the number of ticks of the currently dispatched observer which were not
+ * delivered individually (coalesced or dropped) since its previous handleTick().
+ * Only valid while handleTick() is executed.
+ */
+uint16_t TickHandler::getMissedTicks()
+{
+    return dispatchMissedTicks;
+}
+
+/*
+ * Get the number of ticks which were dropped because tickBuffer was full.
+ */
+uint32_t TickHandler::getOverflowCount()
+{
+    return overflowCount;
+}
+
+/*
+ * Put a tick of an entry into the ring buffer of its priority class (called from the interrupt).
+ * If the entry is already pending (coalescing mode) or the buffer is full,
+ * the tick is recorded as missed tick of the entry.
+ */
+void TickHandler::queueTick(uint8_t entry)
+{
+    TimerEntry *timer = &timerEntry[entry];
+
+#ifdef CFG_TIMER_COALESCE_TICKS
+    if (timer->pending) {
+        if (timer->missedTicks < 0xffff) {
+            timer->missedTicks++;
+        }
+        return;
+    }
+#endif
+
+    uint8_t priority = timer->priority;
+    uint16_t head = bufferHead[priority];
+    uint16_t next = (head + 1) % CFG_TIMER_BUFFER_SIZE;
+
+    if (next == bufferTail[priority]) {
+        overflowCount++;
+        if (timer->missedTicks < 0xffff) {
+            timer->missedTicks++;
         }
+        return;
     }
+
+    tickBuffer[priority][head].entry = entry;
+    tickBuffer[priority][head].timestamp = Clock::micros();
+    tickBuffer[priority][head].time = currentTime;
+    timer->pending = true;
+    bufferHead[priority] = next;
+//    Logger::debug("tickHandler->handle priority=%d, bufferHead=%d, bufferTail=%d, entry=%d", priority, next, bufferTail[priority], entry);
 }
 
 /*
- * Interrupt function for Timer0
+ * Reset a statistics record.
  */
-void timer0Interrupt()
+void TickHandler::clearStatistics(TickStatistics *statistics)
 {
-    tickHandler.handleInterrupt(0);
+    memset(statistics, 0, sizeof(TickStatistics));
+    statistics->latencyMin = 0xffffffff;
+    statistics->durationMin = 0xffffffff;
 }
+
 /*
- * Interrupt function for Timer1
+ * Add the latency and execution time of a dispatched tick to the statistics.
+ * Values are sorted into logarithmic buckets (bucket n holds 2^n to 2^(n+1)-1 us).
  */
-void timer1Interrupt()
+void TickHandler::updateStatistics(TickStatistics *statistics, uint32_t latency, uint32_t duration)
 {
-    tickHandler.handleInterrupt(1);
+    statistics->count++;
+
+    statistics->latencySum += latency;
+    if (latency < statistics->latencyMin) {
+        statistics->latencyMin = latency;
+    }
+    if (latency > statistics->latencyMax) {
+        statistics->latencyMax = latency;
+    }
+    statistics->latencyHistogram[latency < 2 ? 0 : min(31 - __builtin_clz(latency), CFG_TIMER_HISTOGRAM_SIZE - 1)]++;
+
+    statistics->durationSum += duration;
+    if (duration < statistics->durationMin) {
+        statistics->durationMin = duration;
+    }
+    if (duration > statistics->durationMax) {
+        statistics->durationMax = duration;
+    }
+    statistics->durationHistogram[duration < 2 ? 0 : min(31 - __builtin_clz(duration), CFG_TIMER_HISTOGRAM_SIZE - 1)]++;
 }
+
 /*
- * Interrupt function for Timer2
+ * Reset the statistics of all observers and the overflow counter.
  */
-void timer2Interrupt()
+void TickHandler::resetStatistics()
 {
-    tickHandler.handleInterrupt(2);
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
+        clearStatistics(&timerEntry[i].statistics);
+    }
+    overflowCount = 0;
+    interruptCount = 0;
+    idleTime = 0;
+    statisticsStart = Clock::wallMicros();
+    Logger::console("tick statistics reset");
 }
+
 /*
- * Interrupt function for Timer3
+ * Print the dispatch latency and execution time statistics of all observers.
+ * To verify the phase spread, the configured phase is printed together with the
+ * measured position of the last tick within the interval (scheduler time modulo interval, the
+ * same time base as the deadlines).
  */
-void timer3Interrupt()
+void TickHandler::printStatistics()
 {
-    tickHandler.handleInterrupt(3);
+    uint32_t elapsed = Clock::wallMicros() - statisticsStart;
+
+    Logger::console("Tick statistics: %d interrupts, overflows %d, idle %d%% (times in us: min/mean/max)", interruptCount, overflowCount,
+            (uint32_t) (elapsed == 0 ? 0 : (uint64_t) idleTime * 100 / elapsed));
+
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
+        TimerEntry *entry = &timerEntry[i];
+
+        if (entry->observer == NULL) {
+            continue;
+        }
+
+        TickStatistics *statistics = &entry->statistics;
+        if (statistics->count == 0) {
+            Logger::console("%s (%dus, prio %d): no ticks", entry->observer->getCommonName(), entry->interval, entry->priority);
+            continue;
+        }
+        Logger::console("%s (%dus, prio %d, phase %d, measured %d): %d ticks", entry->observer->getCommonName(), entry->interval,
+                entry->priority, entry->phase, statistics->lastTime % entry->interval, statistics->count);
+        Logger::console("  latency %d/%d/%d, duration %d/%d/%d", statistics->latencyMin, (uint32_t) (statistics->latencySum / statistics->count),
+                statistics->latencyMax, statistics->durationMin, (uint32_t) (statistics->durationSum / statistics->count), statistics->durationMax);
+        printHistogram("  latency", statistics->latencyHistogram);
+        printHistogram("  duration", statistics->durationHistogram);
+    }
 }
+
 /*
- * Interrupt function for Timer4
+ * Print the non-empty buckets of a histogram as "lower bound (us):count".
+ * The line is wrapped if it would exceed the log buffer.
  */
-void timer4Interrupt()
+void TickHandler::printHistogram(char *label, uint32_t *histogram)
 {
-    tickHandler.handleInterrupt(4);
+    char line[CFG_LOG_BUFFER_SIZE];
+    int length = snprintf(line, sizeof(line), "%s", label);
+
+    for (int i = 0; i < CFG_TIMER_HISTOGRAM_SIZE; i++) {
+        if (histogram[i] == 0) {
+            continue;
+        }
+        if (length > CFG_LOG_BUFFER_SIZE - 24) {
+            Logger::console("%s", line);
+            length = snprintf(line, sizeof(line), "%s", label);
+        }
+        length += snprintf(line + length, sizeof(line) - length, " %s%lu:%lu", (i == CFG_TIMER_HISTOGRAM_SIZE - 1 ? ">=" : ""),
+                (i == 0 ? 0ul : 1ul << i), histogram[i]);
+    }
+    Logger::console("%s", line);
 }
+
 /*
- * Interrupt function for Timer5
+ * Handle the interrupt of the timer.
+ * The scheduler time is set to the programmed deadline and all entries whose deadline
+ * has passed are queued. Their next deadline is calculated from the previous deadline
+ * (not from the current time) so the ticks don't drift. As the period of the timer is
+ * rounded to its clock, the interrupt may occur slightly before the deadline, if it is
+ * late the current time is used. Finally the timer is programmed to the next deadline.
  */
-void timer5Interrupt()
+void TickHandler::handleInterrupt()
 {
-    tickHandler.handleInterrupt(5);
+    uint32_t now = Clock::micros();
+
+    interruptCount++;
+    queueDueTicks((int32_t) (timerDeadline - now) > 0 ? timerDeadline : now);
+    updateTimer();
 }
+
 /*
- * Interrupt function for Timer6
+ * Set the scheduler time and queue the ticks of all entries whose deadline has passed.
  */
-void timer6Interrupt()
+void TickHandler::queueDueTicks(uint32_t time)
 {
-    tickHandler.handleInterrupt(6);
+    currentTime = time;
+
+    while (scheduleSize > 0) {
+        TimerEntry *entry = &timerEntry[schedule[0]];
+
+        if ((int32_t) (entry->deadline - currentTime) > 0) {
+            break;
+        }
+
+        uint8_t index = schedule[0];
+        if (entry->realign) { // back to the phase after a reschedule()
+            entry->realign = false;
+            alignDeadline(index, currentTime);
+        } else {
+            entry->deadline += entry->interval;
+        }
+        siftDown(0);
+        if (entry->priority == PRIORITY_INTERRUPT) {
+            tickInterrupt(index);
+        } else {
+            queueTick(index);
+        }
+    }
 }
+
 /*
- * Interrupt function for Timer7
+ * Call the observer of an entry with PRIORITY_INTERRUPT directly in interrupt context.
+ * The schedule is already updated, so the observer may detach itself. Such ticks
+ * have no dispatch latency, only the execution time is recorded.
  */
-void timer7Interrupt()
+void TickHandler::tickInterrupt(uint8_t entry)
 {
-    tickHandler.handleInterrupt(7);
+    TimerEntry *timer = &timerEntry[entry];
+    uint32_t start = Clock::wallMicros();
+
+    timer->observer->handleTick();
+    timer->statistics.lastTime = currentTime;
+    updateStatistics(&timer->statistics, 0, Clock::wallMicros() - start);
 }
+
+#ifdef CFG_SIMULATION
 /*
- * Interrupt function for Timer8
+ * Run all tick observers and coroutines for a duration (milliseconds) of virtual time.
+ * Instead of waiting for the timer interrupt, the virtual clock jumps straight to the
+ * next deadline, the due ticks are queued and dispatched immediately. The optional
+ * loop function is called after every step to process everything else which runs in
+ * loop() (e.g. the CAN handlers). The end is calculated on the 64 bit clock, so the
+ * duration is not limited by the overflow of micros() after 71 minutes.
+ * At the end the simulated seconds per wall clock second are reported.
  */
-void timer8Interrupt()
+void TickHandler::simulate(uint32_t milliseconds, void (*loop)())
 {
-    tickHandler.handleInterrupt(8);
+    uint64_t end = Clock::micros64() + (uint64_t) milliseconds * 1000;
+    uint32_t wallStart = Clock::wallMillis();
+
+    while (scheduleSize > 0) {
+        int32_t due = timerEntry[schedule[0]].deadline - Clock::micros();
+
+        if (due > 0) { // not yet due
+            if (Clock::micros64() + due > end) {
+                break;
+            }
+            Clock::advance(due);
+        }
+        queueDueTicks(Clock::micros());
+        process();
+        if (loop != NULL) {
+            loop();
+        }
+    }
+    while (Clock::micros64() < end) {
+        Clock::advance(min(end - Clock::micros64(), 0x40000000ull));
+    }
+    currentTime = Clock::micros(); // no tick is due, keep the scheduler time in sync for reschedule()
+
+    uint32_t wallTime = Clock::wallMillis() - wallStart;
+    Logger::console("simulated %lus in %lums wall time (%lu simulated seconds per second)", milliseconds / 1000, wallTime,
+            milliseconds / (wallTime == 0 ? 1 : wallTime));
+}
+#endif
+
+/*
+ * Interrupt function for the timer
+ */
+void timerInterrupt()
+{
+    tickHandler.handleInterrupt();
 }
 
 /*
@@ -296,3 +940,11 @@ void TickObserver::handleTick()
 {
     Logger::error("TickObserver does not implement handleTick()");
 }
+
+/*
+ * Default implementation of the name used in the tick statistics.
+ */
+char *TickObserver::getCommonName()
+{
+    return "unknown";
+}
@@ -33,52 +33,127 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "config.h"
 #include <DueTimer.h>
 #include "Logger.h"
-
-#define NUM_TIMERS 9
+#include "Coroutine.h"
+#include "Clock.h"
+#include "CriticalSection.h"
 
 class TickObserver
 {
 public:
     virtual void handleTick();
+    virtual char *getCommonName();
 };
 
 class TickHandler
 {
 public:
+    enum TickPriority {
+        PRIORITY_SAFETY, // safety relevant checks (e.g. communication timeouts), always dispatched first
+        PRIORITY_CONTROL, // control loops of actuators
+        PRIORITY_TELEMETRY, // measurement and reporting of values
+        PRIORITY_HOUSEKEEPING, // everything else (e.g. heartbeat, EEPROM cache)
+        NUM_PRIORITIES,
+        PRIORITY_INTERRUPT = NUM_PRIORITIES // not queued, handleTick() is called in the timer interrupt (must be short and interrupt safe)
+    };
+
+    static const uint32_t PHASE_AUTO = 0xffffffff; // place the observer in the largest gap between the auto phases of the same interval
+
     TickHandler();
-    void attach(TickObserver *observer, uint32_t interval);
+    void attach(TickObserver *observer, uint32_t interval, TickPriority priority = PRIORITY_CONTROL, uint32_t phase = PHASE_AUTO);
     bool isAttached(TickObserver* observer, uint32_t interval);
     void detach(TickObserver *observer);
-    void handleInterrupt(int timerNumber);  // must be public when from the non-class functions
+    void setInterval(TickObserver *observer, uint32_t interval);
+    void reschedule(TickObserver *observer, uint32_t delay, bool align = false);
+    void handleInterrupt();  // must be public when from the non-class functions
     void cleanBuffer();
     void process();
+    bool isIdle();
+    void sleep();
+    uint16_t getMissedTicks();
+    uint32_t getOverflowCount();
+    void printStatistics();
+    void resetStatistics();
+    void startCoroutine(Coroutine *coroutine);
+    void stopCoroutine(Coroutine *coroutine);
+    bool isCoroutineRunning(Coroutine *coroutine);
+#ifdef CFG_SIMULATION
+    void simulate(uint32_t milliseconds, void (*loop)() = NULL);
+#endif
 
 protected:
 
 private:
+    struct TickStatistics
+    {
+        uint32_t count; // number of dispatched ticks
+        uint32_t lastTime; // scheduler time (currentTime) at which the last dispatched tick was queued
+        uint32_t latencyMin, latencyMax; // delay between interrupt and dispatch in microseconds
+        uint64_t latencySum;
+        uint32_t durationMin, durationMax; // execution time of handleTick() in microseconds
+        uint64_t durationSum;
+        uint32_t latencyHistogram[CFG_TIMER_HISTOGRAM_SIZE]; // bucket n counts values from 2^n to 2^(n+1)-1 microseconds
+        uint32_t durationHistogram[CFG_TIMER_HISTOGRAM_SIZE];
+    };
+    struct TickQueueEntry
+    {
+        uint8_t entry; // index into timerEntry
+        uint32_t timestamp; // Clock::micros() when the tick was queued
+        uint32_t time; // scheduler time (currentTime) when the tick was queued
+    };
     struct TimerEntry
     {
-        long interval; // interval of timer
-        TickObserver *observer[CFG_TIMER_NUM_OBSERVERS]; // array of pointers to observers with this interval
+        uint32_t interval; // interval of the observer in microseconds
+        uint32_t deadline; // absolute time of the next tick (scheduler time in microseconds)
+        uint32_t phase; // offset of the ticks within the interval in microseconds
+        bool autoPhase; // set if the phase is calculated automatically
+        bool realign; // set by reschedule(), the deadline after the next tick returns to the phase
+        uint8_t heapIndex; // position of this entry in the schedule heap
+        TickPriority priority; // the priority class which determines the queue of the entry
+        volatile bool pending; // set while a tick of this entry is queued in tickBuffer
+        volatile uint16_t missedTicks; // ticks which were coalesced or dropped since the last dispatch
+        TickObserver *observer; // the observer object, NULL if the entry is unused
+        TickStatistics statistics;
     };
-    TimerEntry timerEntry[NUM_TIMERS]; // array of timer entries (9 as there are 9 timers)
-    TickObserver *tickBuffer[CFG_TIMER_BUFFER_SIZE];
-    volatile uint16_t bufferHead, bufferTail;
+    TimerEntry timerEntry[CFG_TIMER_NUM_OBSERVERS]; // array of observer entries
+    uint8_t schedule[CFG_TIMER_NUM_OBSERVERS]; // min-heap of indices into timerEntry, ordered by deadline
+    uint8_t scheduleSize; // number of entries in the schedule heap
+    volatile uint32_t currentTime; // scheduler time in microseconds (Clock::micros() base), set on every interrupt
+    uint32_t timerDeadline; // deadline to which the hardware timer is programmed
+    bool timerRunning; // set while the hardware timer is programmed
+    volatile uint32_t interruptCount; // number of timer interrupts since statisticsStart
+    TickQueueEntry tickBuffer[NUM_PRIORITIES][CFG_TIMER_BUFFER_SIZE]; // per priority a single-producer (interrupt) / single-consumer (process) ring of queued ticks
+    volatile uint16_t bufferHead[NUM_PRIORITIES], bufferTail[NUM_PRIORITIES]; // head is only written by the interrupt, tail only by process()
+    volatile uint32_t overflowCount; // number of ticks which could not be queued because tickBuffer was full
+    uint16_t dispatchMissedTicks; // missed ticks of the observer which is currently dispatched
+    uint32_t idleTime; // microseconds spent in sleep() since statisticsStart
+    uint32_t statisticsStart; // Clock::wallMicros() when the statistics were reset
+    Coroutine *coroutines[CFG_TIMER_NUM_COROUTINES]; // coroutines which are resumed on every process()
 
-    int findTimer(long interval);
-    int findObserver(int timerNumber, TickObserver *observer);
+    int findEntry(TickObserver *observer, uint32_t interval);
+    bool isEarlier(uint8_t entryA, uint8_t entryB);
+    void swapHeap(uint8_t posA, uint8_t posB);
+    void siftUp(uint8_t pos);
+    void siftDown(uint8_t pos);
+    void insertSchedule(uint8_t entry);
+    void removeSchedule(uint8_t entry);
+    void updateTime();
+    void updateTimer();
+    void setPhase(uint8_t entry, uint32_t phase);
+    void alignDeadline(uint8_t entry, uint32_t time);
+    void placePhase(uint8_t entry);
+    void queueTick(uint8_t entry);
+    void queueDueTicks(uint32_t time);
+    void tickInterrupt(uint8_t entry);
+    void dispatch(TickPriority priority);
+    void resumeCoroutines();
+    int findCoroutine(Coroutine *coroutine);
+    void clearStatistics(TickStatistics *statistics);
+    void updateStatistics(TickStatistics *statistics, uint32_t latency, uint32_t duration);
+    void printHistogram(char *label, uint32_t *histogram);
 };
 
 extern TickHandler tickHandler;
 
-void timer0Interrupt();
-void timer1Interrupt();
-void timer2Interrupt();
-void timer3Interrupt();
-void timer4Interrupt();
-void timer5Interrupt();
-void timer6Interrupt();
-void timer7Interrupt();
-void timer8Interrupt();
+void timerInterrupt();
 
 #endif /* TICKHANDLER_H_ */
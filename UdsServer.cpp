@@ -0,0 +1,294 @@
+/*
+ * UdsServer.cpp
+ *
+ * Diagnostic service on the EV bus which answers UDS ReadDataByIdentifier
+ * requests (ISO 14229, service 0x22) via ISO-TP.
+ *
+ * A request may contain several identifiers, the values are collected from
+ * the UdsObserver which attached to each identifier and returned in one
+ * response, e.g. 22 02 06 01 00 -> 62 02 06 <coolant> 01 00 <state>.
+ * This allows GEVCU or a tester to read any value when it's needed instead
+ * of having all values broadcast periodically.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "UdsServer.h"
+#include "DeviceManager.h"
+
+UdsServer udsServer;
+
+UdsServer::UdsServer()
+{
+    numIdentifiers = 0;
+    requests = negativeResponses = lostResponses = 0;
+}
+
+/*
+ * Receive the requests via ISO-TP and attach the identifiers of the system.
+ */
+void UdsServer::setup()
+{
+    isoTp.setListener(this);
+
+    attach(this, UDS_DID_SYSTEM_STATE);
+    attach(this, UDS_DID_DEVICE_STATUS);
+    attach(this, UDS_DID_UPTIME);
+    attach(this, UDS_DID_CAN_STATUS_EV);
+    attach(this, UDS_DID_CAN_STATUS_CAR);
+    attach(this, UDS_DID_ANALOG_IN);
+    attach(this, UDS_DID_SOFTWARE_VERSION);
+}
+
+/*
+ * Register an observer which provides the value of a data identifier.
+ * The list is kept sorted so requests can be answered with a binary search.
+ * If the identifier is already attached, the observer replaces the previous one.
+ */
+void UdsServer::attach(UdsObserver *observer, uint16_t identifier)
+{
+    int i;
+
+    for (i = 0; i < numIdentifiers && identifiers[i].identifier < identifier; i++)
+        ;
+    if (i < numIdentifiers && identifiers[i].identifier == identifier) {
+        identifiers[i].observer = observer;
+        return;
+    }
+    if (numIdentifiers >= CFG_UDS_NUM_IDENTIFIERS) {
+        Logger::error("UDS: unable to attach identifier %#x, no free entry", identifier);
+        return;
+    }
+    memmove(&identifiers[i + 1], &identifiers[i], (numIdentifiers - i) * sizeof(DataIdentifier));
+    identifiers[i].identifier = identifier;
+    identifiers[i].observer = observer;
+    numIdentifiers++;
+}
+
+/*
+ * Remove all identifiers of an observer.
+ */
+void UdsServer::detach(UdsObserver *observer)
+{
+    int count = 0;
+
+    for (int i = 0; i < numIdentifiers; i++) {
+        if (identifiers[i].observer != observer) {
+            identifiers[count++] = identifiers[i];
+        }
+    }
+    numIdentifiers = count;
+}
+
+/*
+ * Look up the observer of a data identifier, NULL if it's unknown.
+ */
+UdsObserver *UdsServer::findObserver(uint16_t identifier)
+{
+    int low = 0, high = numIdentifiers - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (identifiers[mid].identifier == identifier) {
+            return identifiers[mid].observer;
+        }
+        if (identifiers[mid].identifier < identifier) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Handle a request which was received via ISO-TP.
+ */
+void UdsServer::handleIsoTpMessage(IsoTp *isoTp, uint8_t *data, uint16_t length)
+{
+    requests++;
+    switch (data[0]) {
+    case UDS_READ_DATA_BY_IDENTIFIER:
+        readDataByIdentifier(isoTp, data, length);
+        break;
+    default:
+        sendNegativeResponse(isoTp, data[0], NRC_SERVICE_NOT_SUPPORTED);
+        break;
+    }
+}
+
+/*
+ * Answer a ReadDataByIdentifier request: 22 <id hi> <id lo> [<id hi> <id lo> ...]
+ * The response repeats each identifier followed by its value. Unsupported identifiers
+ * and identifiers without a value (e.g. sensor not found) are skipped, the request is
+ * only rejected if none of them could be read.
+ */
+void UdsServer::readDataByIdentifier(IsoTp *isoTp, uint8_t *data, uint16_t length)
+{
+    uint16_t position = 1;
+    bool supported = false;
+
+    if (length < 3 || (length - 1) % 2 != 0) {
+        sendNegativeResponse(isoTp, data[0], NRC_INCORRECT_MESSAGE_LENGTH);
+        return;
+    }
+
+    response[0] = UDS_READ_DATA_BY_IDENTIFIER + UDS_POSITIVE_RESPONSE;
+    for (int i = 1; i < length; i += 2) {
+        uint16_t identifier = (data[i] << 8) | data[i + 1];
+        UdsObserver *observer = findObserver(identifier);
+
+        if (observer == NULL) {
+            continue;
+        }
+        supported = true;
+        // fixed size values are up to 8 bytes, longer ones check maxLength themselves
+        if (position + 2 + 8 > CFG_UDS_RESPONSE_SIZE) {
+            sendNegativeResponse(isoTp, data[0], NRC_RESPONSE_TOO_LONG);
+            return;
+        }
+        putUInt16(response + position, identifier);
+        position += 2;
+
+        uint16_t valueLength = observer->readDataByIdentifier(identifier, response + position, CFG_UDS_RESPONSE_SIZE - position);
+        if (valueLength == 0) { // e.g. sensor not found or value too long
+            position -= 2;
+            continue;
+        }
+        position += valueLength;
+    }
+    if (position == 1) {
+        sendNegativeResponse(isoTp, data[0], supported ? NRC_CONDITIONS_NOT_CORRECT : NRC_REQUEST_OUT_OF_RANGE);
+        return;
+    }
+    sendResponse(isoTp, response, position);
+}
+
+/*
+ * Reject a request: 7F <service id> <negative response code>
+ */
+void UdsServer::sendNegativeResponse(IsoTp *isoTp, uint8_t service, NegativeResponseCode code)
+{
+    uint8_t data[3] = { UDS_NEGATIVE_RESPONSE, service, code };
+
+    negativeResponses++;
+    Logger::debug("UDS: service %#x rejected with code %#x", service, code);
+    sendResponse(isoTp, data, 3);
+}
+
+/*
+ * Pass a response to ISO-TP. If it can't take it (a previous response is still being
+ * sent or the tx queue is full), the response is lost and counted, the tester has to
+ * repeat the request.
+ */
+void UdsServer::sendResponse(IsoTp *isoTp, uint8_t *data, uint16_t length)
+{
+    if (!isoTp->send(data, length)) {
+        lostResponses++;
+        Logger::warn("UDS: response to service %#x (%d bytes) could not be sent", data[0], length);
+    }
+}
+
+/*
+ * Provide the values of the system, which don't belong to a device.
+ */
+uint16_t UdsServer::readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength)
+{
+    uint16_t length = 0;
+
+    switch (identifier) {
+    case UDS_DID_SYSTEM_STATE:
+        data[0] = status.getSystemState();
+        return 1;
+    case UDS_DID_DEVICE_STATUS:
+        for (int i = 0; i < deviceIdsSize && length + 3 <= maxLength; i++) {
+            Device *device = deviceManager.getDeviceByID(deviceIds[i]);
+            if (device != NULL) {
+                putUInt16(data + length, deviceIds[i]);
+                data[length + 2] = (device->isEnabled() ? 1 : 0) | (device->isReady() ? 2 : 0) | (device->isRunning() ? 4 : 0);
+                length += 3;
+            }
+        }
+        return length;
+    case UDS_DID_UPTIME:
+        putUInt32(data, Clock::millis());
+        return 4;
+    case UDS_DID_CAN_STATUS_EV:
+        return readCanStatus(&canHandlerEv, data);
+    case UDS_DID_CAN_STATUS_CAR:
+        return readCanStatus(&canHandlerCar, data);
+    case UDS_DID_ANALOG_IN:
+        for (int i = 0; i < 4; i++) {
+            putUInt16(data + i * 2, status.analogIn[i]);
+        }
+        return 8;
+    case UDS_DID_SOFTWARE_VERSION:
+        length = strlen(CFG_VERSION);
+        if (length > maxLength) {
+            return 0;
+        }
+        memcpy(data, CFG_VERSION, length);
+        return length;
+    }
+    return 0;
+}
+
+uint16_t UdsServer::readCanStatus(CanHandler *canHandler, uint8_t *data)
+{
+    putUInt16(data, canHandler->getLoad());
+    putUInt16(data + 2, canHandler->getPeakLoad());
+    putUInt16(data + 4, canHandler->getBusOffCount());
+    return 6;
+}
+
+/*
+ * Print the number of attached identifiers and handled requests.
+ */
+void UdsServer::printStatistics()
+{
+    Logger::console("UDS: %d identifiers, %d requests, %d negative responses, %d lost responses", numIdentifiers, requests,
+            negativeResponses, lostResponses);
+}
+
+void UdsServer::putUInt16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value >> 8;
+    buffer[1] = value & 0xff;
+}
+
+void UdsServer::putUInt32(uint8_t *buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (value >> (24 - 8 * i)) & 0xff;
+    }
+}
+
+/*
+ * Default implementation of the UdsObserver method. Must be overwritten
+ * by every sub-class which attaches to an identifier.
+ */
+uint16_t UdsObserver::readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength)
+{
+    Logger::error("UdsObserver does not implement readDataByIdentifier(), identifier %#x", identifier);
+    return 0;
+}
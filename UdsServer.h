@@ -0,0 +1,113 @@
+/*
+ * UdsServer.h
+ *
+ * Diagnostic service on the EV bus which answers UDS ReadDataByIdentifier
+ * requests (ISO 14229, service 0x22) with the values of the devices.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef UDSSERVER_H_
+#define UDSSERVER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "IsoTp.h"
+#include "Logger.h"
+
+#define UDS_READ_DATA_BY_IDENTIFIER     0x22 // service id of ReadDataByIdentifier
+#define UDS_POSITIVE_RESPONSE           0x40 // added to the service id in a positive response
+#define UDS_NEGATIVE_RESPONSE           0x7f // service id of a negative response
+
+// data identifiers, all values are big endian
+#define UDS_DID_SYSTEM_STATE            0x0100 // Status::SystemState (1 byte)
+#define UDS_DID_DEVICE_STATUS           0x0101 // per device: id (2 bytes), flags (1 byte, bit 0 = enabled, 1 = ready, 2 = running)
+#define UDS_DID_UPTIME                  0x0102 // milliseconds since start-up (4 bytes)
+#define UDS_DID_CAN_STATUS_EV           0x0110 // EV bus: load, peak load (0.1%, 2 bytes each), bus-off count (2 bytes)
+#define UDS_DID_CAN_STATUS_CAR          0x0111 // car bus: same as UDS_DID_CAN_STATUS_EV
+#define UDS_DID_TEMPERATURE_BATTERY_FRONT_UPPER 0x0200 // temperatures in 0.1 degree celsius (signed, 2 bytes)
+#define UDS_DID_TEMPERATURE_BATTERY_FRONT_LOWER 0x0201
+#define UDS_DID_TEMPERATURE_BATTERY_MID 0x0202
+#define UDS_DID_TEMPERATURE_BATTERY_REAR_LEFT 0x0203
+#define UDS_DID_TEMPERATURE_BATTERY_REAR_RIGHT 0x0204
+#define UDS_DID_TEMPERATURE_BATTERY_TRUNK 0x0205
+#define UDS_DID_TEMPERATURE_COOLANT     0x0206
+#define UDS_DID_TEMPERATURE_EXTERIOR    0x0207
+#define UDS_DID_TEMPERATURE_MINIMUM     0x0210
+#define UDS_DID_TEMPERATURE_MAXIMUM     0x0211
+#define UDS_DID_FLOW_COOLING            0x0300 // flow in ml/sec, total volume in ml (4 bytes each)
+#define UDS_DID_FLOW_HEATER             0x0301
+#define UDS_DID_LOGIC_IO                0x0400 // CanIO::GEVCU_LogicIO as received from GEVCU (2 bytes)
+#define UDS_DID_ANALOG_IN               0x0401 // Status::analogIn[0-3] (2 bytes each)
+#define UDS_DID_SOFTWARE_VERSION        0xf195 // CFG_VERSION (ASCII)
+
+/*
+ * Objects which provide values for data identifiers.
+ */
+class UdsObserver
+{
+public:
+    virtual uint16_t readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength);
+};
+
+class UdsServer: public IsoTpListener, public UdsObserver
+{
+public:
+    enum NegativeResponseCode {
+        NRC_SERVICE_NOT_SUPPORTED = 0x11,
+        NRC_INCORRECT_MESSAGE_LENGTH = 0x13,
+        NRC_RESPONSE_TOO_LONG = 0x14,
+        NRC_CONDITIONS_NOT_CORRECT = 0x22,
+        NRC_REQUEST_OUT_OF_RANGE = 0x31
+    };
+
+    UdsServer();
+    void setup();
+    void attach(UdsObserver *observer, uint16_t identifier);
+    void detach(UdsObserver *observer);
+    void handleIsoTpMessage(IsoTp *isoTp, uint8_t *data, uint16_t length);
+    uint16_t readDataByIdentifier(uint16_t identifier, uint8_t *data, uint16_t maxLength);
+    void printStatistics();
+    static void putUInt16(uint8_t *buffer, uint16_t value);
+    static void putUInt32(uint8_t *buffer, uint32_t value);
+
+private:
+    struct DataIdentifier {
+        uint16_t identifier;
+        UdsObserver *observer;
+    };
+    DataIdentifier identifiers[CFG_UDS_NUM_IDENTIFIERS]; // sorted by identifier
+    uint8_t numIdentifiers;
+    uint8_t response[CFG_UDS_RESPONSE_SIZE];
+    uint32_t requests, negativeResponses, lostResponses;
+
+    UdsObserver *findObserver(uint16_t identifier);
+    void readDataByIdentifier(IsoTp *isoTp, uint8_t *data, uint16_t length);
+    void sendNegativeResponse(IsoTp *isoTp, uint8_t service, NegativeResponseCode code);
+    void sendResponse(IsoTp *isoTp, uint8_t *data, uint16_t length);
+    uint16_t readCanStatus(CanHandler *canHandler, uint8_t *data);
+};
+
+extern UdsServer udsServer;
+
+#endif /* UDSSERVER_H_ */
@@ -47,26 +47,50 @@
  * TIMER INTERVALS
  *
  * specify the intervals (microseconds) at which each device type should be "ticked"
- * try to use the same numbers for several devices because then they will share
- * the same timer (out of a limited number of 9 timers).
+ * all observers share one hardware timer which is programmed to the next deadline,
+ * so the interrupt rate only depends on the number of distinct deadlines.
  */
 #define CFG_TICK_INTERVAL_MEM_CACHE                   40000
 #define CFG_TICK_INTERVAL_HEARTBEAT                 2000000
 #define CFG_TICK_INTERVAL_TEMPERATURE               2000000
 #define CFG_TICK_INTERVAL_EBERSPAECHER_HEATER         60000
+#define CFG_TICK_INTERVAL_EBERSPAECHER_HEATER_IDLE  1000000 // interval while the heater is not powered on
 #define CFG_TICK_INTERVAL_CAN_IO                     200000
 #define CFG_TICK_INTERVAL_FLOW_METER                1000000
+#define CFG_TICK_INTERVAL_MAX                    60000000 // maximum tick interval which can be configured per device
+#define CFG_TICK_INTERVAL_MIN                        1000 // minimum tick interval which can be configured per device
+#define CFG_TIMER_MIN_DELAY                            50 // minimum delay to which the tick timer is programmed (microseconds)
+#define CFG_TIMER_LOW_PRIORITY_BUDGET                 5000 // max microseconds per loop for telemetry/housekeeping ticks (0 = unlimited)
+//#define CFG_SIMULATION // run on a virtual clock which is advanced by TickHandler::simulate() instead of the hardware timer
+#define CFG_IDLE_SLEEP // sleep in loop() until the next interrupt if no work is pending (comment to poll continuously)
+#define CFG_TIMER_COALESCE_TICKS // queue a tick observer only once, further ticks are reported as missed ticks (comment to queue every tick)
 
 /*
  * CAN BUS CONFIGURATION
  */
 #define CFG_CAN0_SPEED CAN_BPS_500K // specify the speed of the CAN0 bus (EV)
 #define CFG_CAN1_SPEED CAN_BPS_33333 // specify the speed of the CAN1 bus (Car / SW-CAN)
+#define CFG_CAN_NUM_MAILBOXES 8 // number of hardware mailboxes per CAN bus
 #define CFG_CAN0_NUM_TX_MAILBOXES 2 // how many of 8 mailboxes are used for TX for CAN0, rest is used for RX
 #define CFG_CAN1_NUM_TX_MAILBOXES 3 // how many of 8 mailboxes are used for TX for CAN1, rest is used for RX
 #define CFG_CAN_IO_MSG_TIMEOUT 1000 // milliseconds a can IO message may be missing before the device faults
+#define CFG_CAN_CYCLE_EBERSPAECHER_HEATER 50000 // period of the frames sent to the heater in microseconds (keep-alive must be within 25-100ms)
+#define CFG_CAN_CYCLE_TEMPERATURE 5000000 // maximum period of the temperature frame sent to GEVCU in microseconds (sent earlier on change)
+#define CFG_CAN_CYCLE_FLOW_METER 5000000 // maximum period of the flow meter frames sent to GEVCU in microseconds (sent earlier on change)
+#define CFG_CAN_INHIBIT_TEMPERATURE 100000 // minimum time between two temperature frames in microseconds
+#define CFG_CAN_INHIBIT_FLOW_METER 100000 // minimum time between two frames of a flow meter in microseconds
+#define CFG_CAN_DEADBAND_TEMPERATURE 1 // change of a temperature (degree celsius) which causes an immediate transmission
+#define CFG_CAN_DEADBAND_FLOW_METER 10 // change of a flow rate (ml/sec) which causes an immediate transmission
 #define CFG_CAN1_HV_MODE_PIN 52 // pin to use to set SW-CAN chip to HV mode (for wake-up)
+#define CFG_CAN_PROCESS_BUDGET 2000 // max microseconds per loop to dispatch received frames (0 = unlimited)
 #define CFG_CAN_TEMPERATURE_OFFSET 50 // offset for temperatures reported via CAN bus - must be the same as in GEVCU !
+#define CFG_INTERNAL_TEMPERATURE_TIMEOUT 10000 // milliseconds after which a temperature from the internal bus is regarded as unknown
+#define CFG_ISOTP_BLOCK_SIZE 8 // number of consecutive frames the sender may send before waiting for our flow control (0 = unlimited)
+#define CFG_ISOTP_SEPARATION_TIME 0 // minimum time between consecutive frames requested from the sender (STmin, 0-127ms)
+#define CFG_ISOTP_TIMEOUT 1000 // milliseconds to wait for a flow control or consecutive frame before a message is aborted
+#define CFG_ISOTP_PADDING 0xcc // value of unused bytes in ISO-TP frames
+#define CFG_CAN_LOAD_WINDOW 100 // milliseconds over which the bus load is measured per window
+//#define CFG_CAN_DIAGNOSTIC_FRAME // send the load and error counters of each bus to GEVCU every CFG_CAN_LOAD_WINDOWS windows
 
 /*
  * HARD CODED PARAMETERS
@@ -83,9 +107,28 @@
  * These values should normally not be changed.
  */
 #define CFG_DEV_MGR_MAX_DEVICES 20 // the maximum number of devices supported by the DeviceManager
+#define CFG_DEV_MGR_QUEUE_SIZE 16 // number of inter-device messages which can wait for delivery
+#define CFG_DEV_MGR_MESSAGE_SIZE 8 // maximum payload of a queued inter-device message (bytes, multiple of 4)
+#define CFG_DEV_MGR_ID_HASH_SIZE 32 // size of the hash table to look up device id's (power of 2, larger than CFG_DEV_MGR_MAX_DEVICES)
+#ifndef CFG_CAN_NUM_OBSERVERS // may be set by the build (e.g. the dispatch benchmark of the host build)
 #define CFG_CAN_NUM_OBSERVERS 10 // maximum number of device subscriptions per CAN bus
-#define CFG_TIMER_NUM_OBSERVERS 9 // the maximum number of supported observers per timer
-#define CFG_TIMER_BUFFER_SIZE 100 // the size of the queuing buffer for TickHandler
+#endif
+#define CFG_CAN_NUM_ROUTES 8 // maximum number of routes which forward frames from a CAN bus to another bus
+#ifndef CFG_CAN_ID_HASH_SIZE
+#define CFG_CAN_ID_HASH_SIZE 32 // size of the hash table to look up CAN id's (power of 2 up to 256, larger than CFG_CAN_NUM_OBSERVERS)
+#endif
+#define CFG_CAN_TX_QUEUE_SIZE 16 // the size of the transmit queue per priority and CAN bus (frames)
+#define CFG_CAN_RX_BUFFER_SIZE 32 // the size of the receive buffer per CAN bus (frames)
+#define CFG_CAN_LOAD_WINDOWS 10 // number of load windows over which the average bus load is calculated
+#define CFG_CAN_CAPTURE_SIZE 256 // number of frames the CAN capture buffer can hold (20 bytes per frame)
+#define CFG_CAN_GATEWAY_BUFFER_SIZE 4096 // bytes buffered for SerialUSB in GVRET gateway mode (12-20 bytes per frame)
+#define CFG_ISOTP_BUFFER_SIZE 2048 // maximum length of an ISO-TP message (max 4095), one buffer for each direction
+#define CFG_UDS_NUM_IDENTIFIERS 32 // maximum number of data identifiers which can be read via UDS
+#define CFG_UDS_RESPONSE_SIZE 256 // maximum length of a UDS response (bytes)
+#define CFG_TIMER_NUM_OBSERVERS 32 // the maximum number of supported tick observers (max 255)
+#define CFG_TIMER_NUM_COROUTINES 8 // the maximum number of simultaneously running coroutines
+#define CFG_TIMER_HISTOGRAM_SIZE 16 // number of logarithmic buckets for tick latency/duration histograms (last one >= 32ms)
+#define CFG_TIMER_BUFFER_SIZE 50 // the size of the queuing buffer per priority class of TickHandler (at least CFG_TIMER_NUM_OBSERVERS + 1 when coalescing)
 #define CFG_SERIAL_SEND_BUFFER_SIZE 120
 #define CFG_MAX_NUM_TEMPERATURE_SENSORS 32
 #define CFG_LOG_BUFFER_SIZE 120 // size of log output messages
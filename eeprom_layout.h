@@ -106,6 +106,7 @@
 
 //first, things in common to all devices - leave 10 bytes for this
 #define EE_CHECKSUM                         0 //1 byte - checksum for this section of EEPROM to makesure it is valid
+#define EE_TICK_INTERVAL                    1 //4 bytes - interval in microseconds at which the device is ticked
 
 // heater data
 #define EEHEAT_MAX_POWER                    10 // 2 bytes
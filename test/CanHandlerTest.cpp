@@ -0,0 +1,254 @@
+/*
+ * CanHandlerTest.cpp
+ *
+ * Tests of the CanHandler transmit path on the due_can stand-in: on a saturated
+ * bus the queued frames must reach the mailboxes by priority, frames queued with
+ * replace must supersede their queued predecessor and a full queue must drop and
+ * count the frames.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "CanHandler.h"
+
+/*
+ * Records the received frames.
+ */
+class TestObserver: public CanObserver
+{
+public:
+    TestObserver() { count = 0; }
+    void handleCanFrame(CAN_FRAME *frame)
+    {
+        if (count < 16) {
+            frames[count] = *frame;
+        }
+        count++;
+    }
+    uint32_t count;
+    CAN_FRAME frames[16];
+};
+
+static CAN_FRAME makeFrame(uint32_t id, uint8_t value, bool extended = false)
+{
+    CAN_FRAME frame;
+
+    canHandlerEv.prepareOutputFrame(&frame, id);
+    frame.extended = extended;
+    frame.data.byte[0] = value;
+    return frame;
+}
+
+/*
+ * Queue a frame with an id and the value in the first byte.
+ */
+static bool send(uint32_t id, uint8_t value, CanHandler::TxPriority priority, bool replace = false, bool extended = false)
+{
+    CAN_FRAME frame = makeFrame(id, value, extended);
+
+    return canHandlerEv.sendFrame(frame, priority, replace);
+}
+
+/*
+ * Let the bus send one frame and refill the mailboxes. Returns the id of the sent frame (0 = none).
+ */
+static uint32_t sendOne(uint8_t *value = NULL)
+{
+    CAN_FRAME frame;
+
+    if (!CAN.completeTransmission(&frame)) {
+        return 0;
+    }
+    if (value != NULL) {
+        *value = frame.data.byte[0];
+    }
+    canHandlerEv.process();
+    return frame.id;
+}
+
+/*
+ * While the mailboxes are busy, the queued frames are handed over by priority and
+ * within a priority in the order they were queued.
+ */
+static void testPriorityOrder()
+{
+    canHandlerEv.resetStatistics();
+    send(0x050, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    send(0x051, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    CHECK_EQUAL(2, CAN.getBusyTxMailboxes()); // the bus is saturated from here on
+
+    send(0x301, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    send(0x302, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    send(0x201, 0, CanHandler::TX_PRIORITY_CONTROL);
+    send(0x101, 0, CanHandler::TX_PRIORITY_SAFETY);
+    send(0x202, 0, CanHandler::TX_PRIORITY_CONTROL);
+    CHECK_EQUAL(2, CAN.getBusyTxMailboxes());
+
+    const uint32_t expected[] = { 0x050, 0x051, 0x101, 0x201, 0x202, 0x301, 0x302 };
+    for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        CHECK_EQUAL(expected[i], sendOne());
+    }
+    CHECK_EQUAL(0, sendOne());
+    CHECK_EQUAL(7, canHandlerEv.getTxSentCount());
+    CHECK_EQUAL(0, canHandlerEv.getTxDroppedCount());
+}
+
+/*
+ * A frame queued with replace supersedes the waiting frame with the same id (and
+ * frame type) in place, other frames are not affected.
+ */
+static void testReplace()
+{
+    canHandlerEv.resetStatistics();
+    send(0x010, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    send(0x011, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+
+    send(0x400, 1, CanHandler::TX_PRIORITY_TELEMETRY, true);
+    send(0x401, 1, CanHandler::TX_PRIORITY_TELEMETRY, true);
+    send(0x400, 1, CanHandler::TX_PRIORITY_TELEMETRY, true, true);
+    send(0x400, 2, CanHandler::TX_PRIORITY_TELEMETRY, true);
+    send(0x400, 3, CanHandler::TX_PRIORITY_TELEMETRY, true);
+    CHECK_EQUAL(2, canHandlerEv.getTxReplacedCount());
+
+    uint8_t value;
+    CHECK_EQUAL(0x010, sendOne());
+    CHECK_EQUAL(0x011, sendOne());
+    CHECK_EQUAL(0x400, sendOne(&value));
+    CHECK_EQUAL(3, value);
+    CHECK_EQUAL(0x400, sendOne(&value)); // the extended frame
+    CHECK_EQUAL(1, value);
+    CHECK_EQUAL(0x401, sendOne());
+    CHECK_EQUAL(0, sendOne());
+}
+
+/*
+ * When a queue is full, further frames of its priority are dropped and counted,
+ * the other priorities still get through.
+ */
+static void testDrop()
+{
+    canHandlerEv.resetStatistics();
+    send(0x010, 0, CanHandler::TX_PRIORITY_SAFETY);
+    send(0x011, 0, CanHandler::TX_PRIORITY_SAFETY);
+
+    uint32_t queued = 0;
+    for (int i = 0; i < CFG_CAN_TX_QUEUE_SIZE + 5; i++) {
+        if (send(0x500 + i, i, CanHandler::TX_PRIORITY_TELEMETRY)) {
+            queued++;
+        }
+    }
+    CHECK_EQUAL(CFG_CAN_TX_QUEUE_SIZE - 1, queued);
+    CHECK_EQUAL(6, canHandlerEv.getTxDroppedCount());
+    CHECK(send(0x100, 0, CanHandler::TX_PRIORITY_SAFETY));
+
+    CHECK_EQUAL(0x010, sendOne());
+    CHECK_EQUAL(0x011, sendOne());
+    CHECK_EQUAL(0x100, sendOne());
+    uint32_t sent = 0;
+    while (sendOne() != 0) {
+        sent++;
+    }
+    CHECK_EQUAL(queued, sent);
+    CHECK_EQUAL(6, canHandlerEv.getTxDroppedCount());
+}
+
+/*
+ * A routed frame replaces a routed frame which is still queued, but never a frame
+ * with the same id which was queued by a device.
+ */
+static void testRoute()
+{
+    canHandlerEv.resetStatistics();
+    CHECK(canHandlerCar.addRoute(&canHandlerEv, 0x400, 0x7ff, false));
+    send(0x050, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+    send(0x051, 0, CanHandler::TX_PRIORITY_TELEMETRY);
+
+    send(0x400, 1, CanHandler::TX_PRIORITY_CONTROL, true);
+    CAN_FRAME frame = makeFrame(0x400, 2);
+    CHECK(CAN2.receiveFrame(frame));
+    frame = makeFrame(0x400, 3);
+    CHECK(CAN2.receiveFrame(frame));
+    CHECK_EQUAL(1, canHandlerEv.getTxReplacedCount());
+
+    uint8_t value, values = 0;
+    CHECK_EQUAL(0x050, sendOne());
+    CHECK_EQUAL(0x051, sendOne());
+    CHECK_EQUAL(0x400, sendOne(&value));
+    values |= 1 << value;
+    CHECK_EQUAL(0x400, sendOne(&value));
+    values |= 1 << value;
+    CHECK_EQUAL((1 << 1) | (1 << 3), values); // the frame of the device and the last routed frame
+    CHECK_EQUAL(0, sendOne());
+
+    canHandlerCar.clearRoutes();
+}
+
+/*
+ * Received frames are only dispatched to observers of the same id and frame type,
+ * even if the mailboxes pass both types (promiscuous mode).
+ */
+static void testReceive()
+{
+    TestObserver standard, extended, masked;
+
+    canHandlerEv.attach(&standard, 0x123, 0x7ff, false);
+    canHandlerEv.attach(&extended, 0x123, 0x1fffffff, true);
+    canHandlerEv.attach(&masked, 0x120, 0x7f0, false);
+    canHandlerEv.setPromiscuous(true);
+
+    CAN_FRAME frame = makeFrame(0x123, 1);
+    CHECK(CAN.receiveFrame(frame));
+    frame = makeFrame(0x123, 2, true);
+    CHECK(CAN.receiveFrame(frame));
+    frame = makeFrame(0x125, 3, true);
+    CHECK(CAN.receiveFrame(frame));
+    canHandlerEv.process();
+
+    CHECK_EQUAL(1, standard.count);
+    CHECK_EQUAL(1, standard.frames[0].data.byte[0]);
+    CHECK_EQUAL(1, extended.count);
+    CHECK_EQUAL(2, extended.frames[0].data.byte[0]);
+    CHECK_EQUAL(1, masked.count);
+
+    canHandlerEv.setPromiscuous(false);
+    canHandlerEv.detach(&standard, 0x123, 0x7ff);
+    canHandlerEv.detach(&extended, 0x123, 0x1fffffff);
+    canHandlerEv.detach(&masked, 0x120, 0x7f0);
+}
+
+int main()
+{
+    Host::setManualTime(true);
+    Host::setOutput(false);
+    canHandlerEv.setup();
+    canHandlerCar.setup();
+
+    RUN_TEST(testPriorityOrder);
+    RUN_TEST(testReplace);
+    RUN_TEST(testDrop);
+    RUN_TEST(testRoute);
+    RUN_TEST(testReceive);
+
+    return testResult();
+}
@@ -0,0 +1,137 @@
+/*
+ * CanSignalBenchmark.cpp
+ *
+ * Compares the decoders and encoders generated from the CAN signal descriptions
+ * with the hand written packing they replaced (data.s1, data.high/low, byte[n])
+ * on the frames of CanIO, FlowMeter and Temperature.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "CanIO.h"
+#include "FlowMeter.h"
+#include "Temperature.h"
+
+#define NUM_FRAMES 1024
+#define NUM_ROUNDS 20000
+
+static BytesUnion frames[NUM_FRAMES];
+
+/*
+ * The hand written versions (as before the migration) and the signal versions.
+ * They are not inlined so the compiler can not merge the loops of the two.
+ */
+static uint32_t __attribute__((noinline)) decodeByHand(const BytesUnion *data)
+{
+    return data->byte[4] + data->s1 + data->s0 + data->s2 + data->s3;
+}
+
+static uint32_t __attribute__((noinline)) decodeBySignal(const BytesUnion *data)
+{
+    return GevcuSystemStateSignal::decode(*data) + GevcuLogicIOSignal::decode(*data) + GevcuAnalogIn1Signal::decode(*data)
+            + GevcuAnalogIn3Signal::decode(*data) + GevcuAnalogIn4Signal::decode(*data);
+}
+
+static void __attribute__((noinline)) encodeByHand(BytesUnion *data, uint32_t value)
+{
+    data->high = value;
+    data->low = value * 3;
+    data->byte[6] = constrain((int16_t) value + CFG_CAN_TEMPERATURE_OFFSET, 0, 255);
+}
+
+static void __attribute__((noinline)) encodeBySignal(BytesUnion *data, uint32_t value)
+{
+    FlowRateSignal::encode(*data, value);
+    FlowTotalSignal::encode(*data, value * 3);
+    TemperatureCoolantSignal::encode(*data, (int16_t) value);
+}
+
+/*
+ * Run a decoder over all frames and return the time in ns per frame.
+ */
+static uint32_t measureDecode(uint32_t (*decoder)(const BytesUnion *data), uint32_t *sum)
+{
+    uint32_t start = micros();
+
+    *sum = 0;
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        for (int i = 0; i < NUM_FRAMES; i++) {
+            *sum += decoder(&frames[i]);
+        }
+    }
+    return (uint64_t) (micros() - start) * 1000000 / ((uint64_t) NUM_ROUNDS * NUM_FRAMES);
+}
+
+static uint32_t measureEncode(void (*encoder)(BytesUnion *data, uint32_t value), uint64_t *sum)
+{
+    uint32_t start = micros();
+
+    *sum = 0;
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        for (int i = 0; i < NUM_FRAMES; i++) {
+            encoder(&frames[i], round * NUM_FRAMES + i);
+            *sum += frames[i].value;
+        }
+    }
+    return (uint64_t) (micros() - start) * 1000000 / ((uint64_t) NUM_ROUNDS * NUM_FRAMES);
+}
+
+/*
+ * Both versions must compute the same values, the generated code must not be
+ * noticeably slower (the margin allows for noise of the host).
+ */
+static void benchmarkSignals()
+{
+    uint32_t handSum, signalSum;
+    uint64_t handFrames, signalFrames;
+
+    srand(1);
+    for (int i = 0; i < NUM_FRAMES; i++) {
+        for (int j = 0; j < 8; j++) {
+            frames[i].bytes[j] = rand();
+        }
+    }
+
+    uint32_t handDecode = measureDecode(decodeByHand, &handSum);
+    uint32_t signalDecode = measureDecode(decodeBySignal, &signalSum);
+    CHECK_EQUAL(handSum, signalSum);
+
+    uint32_t handEncode = measureEncode(encodeByHand, &handFrames);
+    uint32_t signalEncode = measureEncode(encodeBySignal, &signalFrames);
+    CHECK(handFrames == signalFrames);
+
+    printf("decode: %lu ps/frame by hand, %lu ps/frame by signal\n", (unsigned long) handDecode, (unsigned long) signalDecode);
+    printf("encode: %lu ps/frame by hand, %lu ps/frame by signal\n", (unsigned long) handEncode, (unsigned long) signalEncode);
+    CHECK(signalDecode <= handDecode * 5 / 4 + 100);
+    CHECK(signalEncode <= handEncode * 5 / 4 + 100);
+}
+
+int main()
+{
+    Host::setOutput(false);
+
+    RUN_TEST(benchmarkSignals);
+
+    return testResult();
+}
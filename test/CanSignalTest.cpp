@@ -0,0 +1,213 @@
+/*
+ * CanSignalTest.cpp
+ *
+ * Table driven tests of the CAN signal encoders and decoders: Intel and Motorola
+ * byte order, signals of 1 to 32 bits at the edges of the frame, signed raw values,
+ * scaling and the limitation of encoded values to the range of the signal.
+ * The expected bytes were calculated with the DBC bit numbering.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "CanSignal.h"
+#include "CanIO.h"
+#include "FlowMeter.h"
+#include "Temperature.h"
+
+/*
+ * Adapters so signals of any type can be listed in one table.
+ */
+template<class Signal> static uint32_t decodeRaw(const BytesUnion &data)
+{
+    return Signal::decodeRaw(data);
+}
+
+template<class Signal> static void encodeRaw(BytesUnion &data, uint32_t raw)
+{
+    Signal::encodeRaw(data, raw);
+}
+
+template<class Signal> static int64_t decode(const BytesUnion &data)
+{
+    return Signal::decode(data);
+}
+
+template<class Signal> static void encode(BytesUnion &data, int64_t physical)
+{
+    Signal::encode(data, physical);
+}
+
+#define RAW_SIGNAL(...) #__VA_ARGS__, decodeRaw<CanSignal<__VA_ARGS__> >, encodeRaw<CanSignal<__VA_ARGS__> >
+#define SIGNAL(...) #__VA_ARGS__, decode<__VA_ARGS__ >, encode<__VA_ARGS__ >
+
+struct RawCase
+{
+    const char *signal;
+    uint32_t (*decodeRaw)(const BytesUnion &data);
+    void (*encodeRaw)(BytesUnion &data, uint32_t raw);
+    uint32_t raw;
+    uint8_t bytes[8]; // the frame with only this signal set
+};
+
+static const RawCase rawCases[] = {
+    { RAW_SIGNAL(8, 8), 0x12, { 0x00, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(16, 16), 0x1234, { 0x00, 0x00, 0x34, 0x12, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(32, 32), 0x12345678, { 0x00, 0x00, 0x00, 0x00, 0x78, 0x56, 0x34, 0x12 } },
+    { RAW_SIGNAL(4, 12), 0xabc, { 0xc0, 0xab, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(0, 1), 1, { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(63, 1), 1, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80 } },
+    { RAW_SIGNAL(3, 32), 0x89abcdef, { 0x78, 0x6f, 0x5e, 0x4d, 0x04, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(44, 20), 0xfedcb, { 0x00, 0x00, 0x00, 0x00, 0x00, 0xb0, 0xdc, 0xfe } },
+    { RAW_SIGNAL(7, 16, CAN_MOTOROLA), 0x1234, { 0x12, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(7, 12, CAN_MOTOROLA), 0xabc, { 0xab, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(3, 4, CAN_MOTOROLA), 0xa, { 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(39, 32, CAN_MOTOROLA), 0x12345678, { 0x00, 0x00, 0x00, 0x00, 0x12, 0x34, 0x56, 0x78 } },
+    { RAW_SIGNAL(56, 1, CAN_MOTOROLA), 1, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 } },
+    { RAW_SIGNAL(1, 10, CAN_MOTOROLA), 0x2a5, { 0x02, 0xa5, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { RAW_SIGNAL(13, 20, CAN_MOTOROLA), 0xabcde, { 0x00, 0x2a, 0xf3, 0x78, 0x00, 0x00, 0x00, 0x00 } },
+};
+
+struct PhysicalCase
+{
+    const char *signal;
+    int64_t (*decode)(const BytesUnion &data);
+    void (*encode)(BytesUnion &data, int64_t physical);
+    int64_t physical; // the value which is encoded
+    uint8_t bytes[8]; // the expected frame
+    int64_t decoded; // the expected value when the frame is decoded (differs if the value was limited)
+};
+
+static const PhysicalCase physicalCases[] = {
+    { SIGNAL(CanSignal<0, 8, CAN_INTEL, CAN_SIGNED, int32_t>), -1, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -1 },
+    { SIGNAL(CanSignal<4, 12, CAN_INTEL, CAN_SIGNED, int32_t>), -2048, { 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -2048 },
+    { SIGNAL(CanSignal<4, 12, CAN_INTEL, CAN_SIGNED, int32_t>), -3000, { 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -2048 },
+    { SIGNAL(CanSignal<4, 12, CAN_INTEL, CAN_SIGNED, int32_t>), 5000, { 0xf0, 0x7f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 2047 },
+    { SIGNAL(CanSignal<7, 16, CAN_MOTOROLA, CAN_SIGNED, int32_t>), -2, { 0xff, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -2 },
+    { SIGNAL(CanSignal<0, 32, CAN_INTEL, CAN_SIGNED, int32_t>), INT32_MIN, { 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00 }, INT32_MIN },
+    { SIGNAL(CanSignal<7, 32, CAN_MOTOROLA, CAN_SIGNED, int32_t>), -1, { 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00 }, -1 },
+    { SIGNAL(CanSignal<0, 8, CAN_INTEL, CAN_UNSIGNED, int32_t>), -5, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 0 },
+    { SIGNAL(CanSignal<0, 8, CAN_INTEL, CAN_UNSIGNED, int32_t>), 300, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 255 },
+    { SIGNAL(CanSignal<0, 1, CAN_INTEL, CAN_UNSIGNED, int32_t>), 2, { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 1 },
+    { SIGNAL(CanSignal<0, 16, CAN_INTEL, CAN_SIGNED, int32_t, 1, 10, -40>), 25, { 0x8a, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 25 },
+    { SIGNAL(CanSignal<8, 8, CAN_INTEL, CAN_UNSIGNED, int32_t, 5, 1, -100>), 0, { 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 0 },
+    { SIGNAL(CanSignal<8, 8, CAN_INTEL, CAN_UNSIGNED, int32_t, 5, 1, -100>), 2000, { 0x00, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 1175 },
+    { SIGNAL(TemperatureBatteryMidSignal), 25, { 0x00, 0x00, 0x4b, 0x00, 0x00, 0x00, 0x00, 0x00 }, 25 },
+    { SIGNAL(TemperatureBatteryMidSignal), -60, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -50 },
+    { SIGNAL(TemperatureBatteryMidSignal), 300, { 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00 }, 205 },
+    { SIGNAL(InternalTemperatureSignal), -123, { 0x85, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, -123 },
+    { SIGNAL(FlowRateSignal), 0xfffffffful, { 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff }, 0xfffffffful },
+};
+
+static bool checkBytes(const char *signal, const BytesUnion &data, const uint8_t *expected)
+{
+    if (memcmp(data.bytes, expected, 8)) {
+        printf("%s: expected %02x %02x %02x %02x %02x %02x %02x %02x, got %02x %02x %02x %02x %02x %02x %02x %02x\n", signal,
+                expected[0], expected[1], expected[2], expected[3], expected[4], expected[5], expected[6], expected[7],
+                data.bytes[0], data.bytes[1], data.bytes[2], data.bytes[3], data.bytes[4], data.bytes[5], data.bytes[6], data.bytes[7]);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Encode the raw value into an empty frame, decode it from the expected frame and
+ * check that encoding into a frame full of ones only changes the bits of the signal.
+ */
+static void testRaw()
+{
+    for (size_t i = 0; i < sizeof(rawCases) / sizeof(rawCases[0]); i++) {
+        const RawCase &test = rawCases[i];
+        BytesUnion data, ones, expectedOnes;
+
+        data.value = 0;
+        test.encodeRaw(data, test.raw);
+        CHECK(checkBytes(test.signal, data, test.bytes));
+
+        memcpy(data.bytes, test.bytes, 8);
+        CHECK_EQUAL(test.raw, test.decodeRaw(data));
+
+        // the signal bits are the ones set in a frame with the maximum raw value
+        expectedOnes.value = 0;
+        test.encodeRaw(expectedOnes, 0xffffffff);
+        expectedOnes.value = ~expectedOnes.value;
+        ones.value = ~0ull;
+        test.encodeRaw(ones, 0);
+        CHECK(checkBytes(test.signal, ones, expectedOnes.bytes));
+        ones.value = ~0ull;
+        test.encodeRaw(ones, test.raw);
+        CHECK_EQUAL(test.raw, test.decodeRaw(ones));
+    }
+}
+
+/*
+ * Encode the physical value (with scaling, sign and limitation) and decode it again.
+ */
+static void testPhysical()
+{
+    for (size_t i = 0; i < sizeof(physicalCases) / sizeof(physicalCases[0]); i++) {
+        const PhysicalCase &test = physicalCases[i];
+        BytesUnion data;
+
+        data.value = 0;
+        test.encode(data, test.physical);
+        CHECK(checkBytes(test.signal, data, test.bytes));
+        CHECK_EQUAL(test.decoded, test.decode(data));
+    }
+}
+
+/*
+ * The frames which were hand packed before: the signals must produce the same bytes.
+ */
+static void testMigratedFrames()
+{
+    BytesUnion data;
+
+    for (int i = 0; i < 8; i++) {
+        data.bytes[i] = 0x11 * (i + 1);
+    }
+    CHECK_EQUAL(data.byte[4], GevcuSystemStateSignal::decode(data));
+    CHECK_EQUAL(data.s1, GevcuLogicIOSignal::decode(data));
+    CHECK_EQUAL(data.s0, GevcuAnalogIn1Signal::decode(data));
+    CHECK_EQUAL(data.s1, GevcuAnalogIn2Signal::decode(data));
+    CHECK_EQUAL(data.s2, GevcuAnalogIn3Signal::decode(data));
+    CHECK_EQUAL(data.s3, GevcuAnalogIn4Signal::decode(data));
+    CHECK_EQUAL(data.s0, InternalLogicIOSignal::decode(data));
+    CHECK_EQUAL(data.byte[2], InternalSystemStateSignal::decode(data));
+
+    FlowTotalSignal::encode(data, 0x12345678);
+    FlowRateSignal::encode(data, 0x9abcdef0);
+    CHECK_EQUAL(0x12345678, data.low);
+    CHECK_EQUAL(0x9abcdef0, data.high);
+}
+
+int main()
+{
+    Host::setOutput(false);
+
+    RUN_TEST(testRaw);
+    RUN_TEST(testPhysical);
+    RUN_TEST(testMigratedFrames);
+
+    return testResult();
+}
@@ -0,0 +1,154 @@
+/*
+ * DispatchBenchmark.cpp
+ *
+ * Measures the throughput of received CAN frames through the receive buffer and
+ * the dispatch index of CanHandler with 10, 50 and 200 subscriptions (built with
+ * CFG_CAN_NUM_OBSERVERS 200). For comparison the same subscriptions are also
+ * matched with a linear id/mask scan like before the index was introduced (only
+the matching, without the receive buffer).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "CanHandler.h"
+
+#if CFG_CAN_NUM_OBSERVERS < 200
+#error "the dispatch benchmark must be built with CFG_CAN_NUM_OBSERVERS 200"
+#endif
+
+#define NUM_FRAMES 2000000
+#define NUM_IDS 256 // the frames cycle through this many different ids
+
+/*
+ * Counts the received frames.
+ */
+class CountingObserver: public CanObserver
+{
+public:
+    CountingObserver() { count = 0; }
+    void handleCanFrame(CAN_FRAME *frame) { count++; }
+    uint32_t count;
+};
+
+static CountingObserver observers[200];
+static uint32_t subscribedId[200], subscribedMask[200];
+
+/*
+ * Every 10th subscription is a range of 4 ids, the others subscribe to one id.
+ * The ids are spread over the standard range so not every frame has a subscriber.
+ */
+static void subscribe(uint16_t count)
+{
+    for (int i = 0; i < count; i++) {
+        subscribedId[i] = 0x100 + i * 3;
+        subscribedMask[i] = (i % 10 == 9 ? 0x7fc : 0x7ff);
+        observers[i].count = 0;
+        canHandlerEv.attach(&observers[i], subscribedId[i], subscribedMask[i], false);
+    }
+}
+
+static void unsubscribe(uint16_t count)
+{
+    for (int i = 0; i < count; i++) {
+        canHandlerEv.detach(&observers[i], subscribedId[i], subscribedMask[i]);
+    }
+}
+
+/*
+ * Feed the frames in bursts through the receive interrupt handler and process() and
+ * return the frames per second.
+ */
+static uint32_t measureDispatch(uint32_t *delivered)
+{
+    CAN_FRAME frame;
+    uint32_t start = micros();
+
+    canHandlerEv.prepareOutputFrame(&frame, 0);
+    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+        frame.id = 0x100 + (i * 7) % NUM_IDS * 3; // every third id might be subscribed
+        canHandlerEv.handleReceive(&frame);
+        if (i % 16 == 15) {
+            canHandlerEv.process();
+        }
+    }
+    while (!canHandlerEv.isIdle()) {
+        canHandlerEv.process();
+    }
+    uint32_t time = max(micros() - start, 1u);
+
+    *delivered = 0;
+    for (int i = 0; i < 200; i++) {
+        *delivered += observers[i].count;
+    }
+    return (uint64_t) NUM_FRAMES * 1000000 / time;
+}
+
+/*
+ * The same frames matched by comparing id and mask of every subscription.
+ */
+static uint32_t measureLinearScan(uint16_t count, uint32_t *delivered)
+{
+    uint32_t start = micros();
+
+    *delivered = 0;
+    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+        uint32_t id = 0x100 + (i * 7) % NUM_IDS * 3;
+        for (int j = 0; j < count; j++) {
+            if ((id & subscribedMask[j]) == (subscribedId[j] & subscribedMask[j])) {
+                observers[j].handleCanFrame(NULL);
+                (*delivered)++;
+            }
+        }
+    }
+    uint32_t time = max(micros() - start, 1u);
+    return (uint64_t) NUM_FRAMES * 1000000 / time;
+}
+
+static void benchmark(uint16_t count)
+{
+    uint32_t indexed, scanned;
+
+    subscribe(count);
+    canHandlerEv.resetStatistics();
+    uint32_t indexedRate = measureDispatch(&indexed);
+    uint32_t scannedRate = measureLinearScan(count, &scanned);
+    unsubscribe(count);
+
+    printf("%3d subscriptions: %8lu frames/s buffered and indexed (%lu ns/frame), %8lu frames/s linear scan (matching only)\n", count, (unsigned long) indexedRate,
+            (unsigned long) (1000000000ull / indexedRate), (unsigned long) scannedRate);
+    CHECK_EQUAL(scanned, indexed);
+    CHECK_EQUAL(0, canHandlerEv.getOverrunCount());
+}
+
+int main()
+{
+    Host::setOutput(false);
+    canHandlerEv.setup();
+
+    benchmark(10);
+    benchmark(50);
+    benchmark(200);
+
+    return testResult();
+}
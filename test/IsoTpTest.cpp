@@ -0,0 +1,141 @@
+/*
+ * IsoTpTest.cpp
+ *
+ * Tests of the ISO-TP transport: frames with a data length code which is too
+ * short for their content are rejected and a message whose frame can't be
+ * queued is reported as not sent.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "IsoTp.h"
+
+#define REQUEST_ID 0x7e0
+#define RESPONSE_ID 0x7e8
+
+/*
+ * Records the received messages.
+ */
+class TestListener: public IsoTpListener
+{
+public:
+    TestListener() { count = length = 0; }
+    void handleIsoTpMessage(IsoTp *isoTp, uint8_t *data, uint16_t length)
+    {
+        this->length = length;
+        count++;
+    }
+    uint32_t count;
+    uint16_t length;
+};
+
+static IsoTp transport(&canHandlerEv, REQUEST_ID, RESPONSE_ID);
+static TestListener listener;
+
+/*
+ * Receive a frame of the tester with the given data length code.
+ */
+static void receive(uint8_t length, uint8_t b0, uint8_t b1 = 0, uint8_t b2 = 0)
+{
+    CAN_FRAME frame;
+
+    canHandlerEv.prepareOutputFrame(&frame, REQUEST_ID);
+    frame.length = length;
+    frame.data.byte[0] = b0;
+    frame.data.byte[1] = b1;
+    frame.data.byte[2] = b2;
+    CAN.receiveFrame(frame);
+    canHandlerEv.process();
+}
+
+/*
+ * Let the bus send all queued frames, return the first byte of the last one (0 = none).
+ */
+static uint8_t drain()
+{
+    CAN_FRAME frame;
+    uint8_t pci = 0;
+
+    while (CAN.completeTransmission(&frame)) {
+        pci = frame.data.byte[0];
+        canHandlerEv.process();
+    }
+    return pci;
+}
+
+/*
+ * A first frame must have 8 bytes, a consecutive frame at least the remaining data.
+ */
+static void testShortFrames()
+{
+    listener.count = 0;
+    receive(5, 0x10, 10); // first frame of 10 bytes with only 3 bytes data
+    CHECK_EQUAL(0, drain()); // no flow control
+
+    receive(8, 0x10, 10);
+    CHECK_EQUAL(0x30, drain()); // flow control: continue
+    receive(3, 0x21); // the remaining 4 bytes don't fit into 2
+    receive(5, 0x21); // the message was aborted
+    CHECK_EQUAL(0, listener.count);
+
+    receive(8, 0x10, 10);
+    CHECK_EQUAL(0x30, drain());
+    receive(5, 0x21);
+    CHECK_EQUAL(1, listener.count);
+    CHECK_EQUAL(10, listener.length);
+}
+
+/*
+ * A message is not sent if its frame is dropped by the full tx queue.
+ */
+static void testDroppedFrame()
+{
+    uint8_t data[10] = { 0 };
+    CAN_FRAME frame;
+
+    canHandlerEv.prepareOutputFrame(&frame, 0x100);
+    while (canHandlerEv.sendFrame(frame, CanHandler::TX_PRIORITY_TELEMETRY))
+        ;
+    CHECK(!transport.send(data, 3));
+    CHECK(!transport.send(data, 10));
+    CHECK(transport.isIdle());
+
+    drain();
+    CHECK(transport.send(data, 3));
+    CHECK_EQUAL(0x03, drain()); // single frame
+}
+
+int main()
+{
+    Host::setManualTime(true);
+    Host::setOutput(false);
+    canHandlerEv.setup();
+    transport.setup();
+    transport.setListener(&listener);
+
+    RUN_TEST(testShortFrames);
+    RUN_TEST(testDroppedFrame);
+
+    return testResult();
+}
@@ -0,0 +1,166 @@
+/*
+ * SimulationBenchmark.cpp
+ *
+ * Runs the devices of the sketch on the virtual clock (CFG_SIMULATION) with a
+ * GEVCU stand-in on the EV bus and reports the simulated seconds per wall clock
+ * second. Also verifies that runs longer than the 71 minute overflow of micros()
+ * keep the exact number of ticks.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "DeviceManager.h"
+#include "CanHandler.h"
+#include "IsoTp.h"
+#include "UdsServer.h"
+#include "TickHandler.h"
+#include "MemCache.h"
+#include "Heartbeat.h"
+#include "Temperature.h"
+#include "EberspaecherHeater.h"
+#include "CanIO.h"
+#include "FlowMeter.h"
+
+#ifndef CFG_SIMULATION
+#error "the simulation benchmark must be built with CFG_SIMULATION"
+#endif
+
+static uint32_t framesSent = 0;
+
+/*
+ * Counts its ticks.
+ */
+class CountingObserver: public TickObserver
+{
+public:
+    CountingObserver() { count = 0; }
+    void handleTick() { count++; }
+    char *getCommonName() { return "counter"; }
+    uint32_t count;
+};
+
+/*
+ * Sends the status and analog frames of GEVCU every 100ms, walking the system
+ * state up to running.
+ */
+class GevcuStandIn: public TickObserver
+{
+public:
+    GevcuStandIn() { step = 0; }
+    void handleTick()
+    {
+        static const Status::SystemState states[] = { Status::preCharge, Status::preCharged, Status::ready, Status::running };
+        CAN_FRAME frame;
+
+        memset(&frame, 0, sizeof(frame));
+        frame.id = CAN_ID_GEVCU_STATUS;
+        frame.length = 8;
+        GevcuSystemStateSignal::encode(&frame, states[min(step, 3)]);
+        GevcuLogicIOSignal::encode(&frame, CanIO::heaterPump | CanIO::coolingPump);
+        CAN.receiveFrame(frame);
+
+        frame.id = CAN_ID_GEVCU_ANALOG_IO;
+        GevcuAnalogIn1Signal::encode(&frame, 1000 + (step % 600)); // slowly varying water temperature
+        CAN.receiveFrame(frame);
+        step++;
+    }
+    char *getCommonName() { return "GEVCU"; }
+    uint32_t step;
+};
+
+/*
+ * Everything which runs in loop() besides the tick handler. The frames in the tx
+ * mailboxes are sent right away.
+ */
+static void processLoop()
+{
+    canHandlerEv.process();
+    canHandlerCar.process();
+    canHandlerInternal.process();
+    deviceManager.process();
+    isoTp.process();
+    while (CAN.completeTransmission() || CAN2.completeTransmission()) {
+        framesSent++;
+    }
+}
+
+/*
+ * 2 hours are longer than the overflow of the 32 bit microseconds.
+ */
+static void testLongRun()
+{
+    CountingObserver counter;
+    uint64_t start = Clock::micros64();
+
+    tickHandler.attach(&counter, 1000000, TickHandler::PRIORITY_CONTROL, 0);
+    tickHandler.simulate(2 * 3600 * 1000);
+
+    CHECK_EQUAL(2 * 3600, counter.count);
+    CHECK_EQUAL(2ull * 3600 * 1000000, Clock::micros64() - start);
+    tickHandler.detach(&counter);
+}
+
+/*
+ * Simulate a day of operation of all devices and report the speed.
+ */
+static void benchmarkDevices()
+{
+    GevcuStandIn gevcu;
+    const uint32_t hours = 24;
+
+    memCache.setup();
+    canHandlerEv.setup();
+    canHandlerCar.setup();
+    canHandlerInternal.setup();
+    isoTp.setup();
+    udsServer.setup();
+    Device *devices[] = { new Heartbeat(), new Temperature(), new EberspaecherHeater(), new CanIO(),
+            new FlowMeter(FLOW_METER_COOLING, CFG_FLOW_METER_COOLING), new FlowMeter(FLOW_METER_HEATER, CFG_FLOW_METER_HEATER) };
+    for (unsigned int i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+        deviceManager.addDevice(devices[i]);
+        devices[i]->enable(); // the emulated EEPROM is blank
+    }
+    status.setSystemState(Status::init);
+    tickHandler.attach(&gevcu, 100000, TickHandler::PRIORITY_CONTROL);
+
+    uint32_t wallStart = Clock::wallMillis();
+    tickHandler.simulate(hours * 3600 * 1000, processLoop);
+    uint32_t wallTime = max(Clock::wallMillis() - wallStart, 1u);
+
+    printf("simulated %luh in %lums wall time: %lu simulated seconds per wall second, %lu frames sent, system state %s\n",
+            (unsigned long) hours, (unsigned long) wallTime, (unsigned long) (hours * 3600 * 1000 / wallTime), (unsigned long) framesSent,
+            status.systemStateToStr(status.getSystemState()));
+    CHECK_EQUAL(Status::running, status.getSystemState());
+    CHECK(framesSent >= hours * 3600 / 5 * 3); // at least the temperature and the two flow frames every 5s
+}
+
+int main()
+{
+    Host::setOutput(false);
+
+    RUN_TEST(testLongRun);
+    RUN_TEST(benchmarkDevices);
+
+    return testResult();
+}
@@ -0,0 +1,72 @@
+/*
+ * TestHelper.h
+ *
+ * Minimal assertion helpers for the host tests (see Makefile).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef TESTHELPER_H_
+#define TESTHELPER_H_
+
+#include <Arduino.h>
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        long long expectedValue = (long long) (expected), actualValue = (long long) (actual); \
+        if (expectedValue != actualValue) { \
+            printf("%s:%d: %s: expected %lld, got %lld\n", __FILE__, __LINE__, #actual, expectedValue, actualValue); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        printf("%s\n", #test); \
+        test(); \
+    } while (0)
+
+/*
+ * Print the summary and return the exit code of the test program.
+ */
+static int testResult()
+{
+    if (testFailures != 0) {
+        printf("FAILED (%d checks)\n", testFailures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+#endif /* TESTHELPER_H_ */
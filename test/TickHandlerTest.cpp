@@ -0,0 +1,210 @@
+/*
+ * TickHandlerTest.cpp
+ *
+ * Tests of the TickHandler scheduling on the manual host time: the hardware
+ * timer must be programmed to the next deadline so every tick happens on time
+ * with one interrupt per distinct deadline.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TestHelper.h"
+#include "TickHandler.h"
+
+/*
+ * Records the times of its ticks.
+ */
+class TestObserver: public TickObserver
+{
+public:
+    TestObserver() { count = 0; }
+    void handleTick()
+    {
+        if (count < 64) {
+            times[count] = Clock::micros();
+        }
+        count++;
+    }
+    char *getCommonName() { return "test"; }
+
+    uint32_t count;
+    uint32_t times[64];
+};
+
+/*
+ * Advance the manual time in steps and dispatch the queued ticks after each step.
+ */
+static void run(uint32_t duration, uint32_t step = 1000)
+{
+    for (uint32_t time = 0; time < duration; time += step) {
+        Host::advance(step);
+        tickHandler.process();
+    }
+}
+
+/*
+ * Three 5s observers at 0, 1666666 and 3333333us (the greatest common divisor of
+ * the phases is 1us) must not cause more than one interrupt per deadline.
+ */
+static void testCoprimePhases()
+{
+    TestObserver a, b, c;
+    uint32_t start = Clock::micros();
+
+    tickHandler.resetStatistics();
+    tickHandler.attach(&a, 5000000, TickHandler::PRIORITY_INTERRUPT, 0);
+    tickHandler.attach(&b, 5000000, TickHandler::PRIORITY_INTERRUPT, 1666666);
+    tickHandler.attach(&c, 5000000, TickHandler::PRIORITY_INTERRUPT, 3333333);
+    uint32_t interrupts = Timer0.getInterruptCount();
+    run(15000000);
+
+    CHECK_EQUAL(3, a.count);
+    CHECK_EQUAL(3, b.count);
+    CHECK_EQUAL(3, c.count);
+    CHECK_EQUAL(0, a.times[0] % 5000000);
+    CHECK_EQUAL(1666666, b.times[0] % 5000000);
+    CHECK_EQUAL(3333333, c.times[0] % 5000000);
+    CHECK_EQUAL(5000000, b.times[1] - b.times[0]);
+    CHECK_EQUAL(9, Timer0.getInterruptCount() - interrupts);
+    CHECK(a.times[0] - start <= 5000000);
+
+    tickHandler.detach(&a);
+    tickHandler.detach(&b);
+    tickHandler.detach(&c);
+    CHECK(!Timer0.isRunning());
+}
+
+/*
+ * A fast observer keeps its exact period and a slow one doesn't disturb it.
+ */
+static void testExactPeriod()
+{
+    TestObserver fast, slow;
+    uint32_t interrupts = Timer0.getInterruptCount();
+
+    tickHandler.attach(&fast, 1000, TickHandler::PRIORITY_INTERRUPT, 250);
+    tickHandler.attach(&slow, 1000000, TickHandler::PRIORITY_CONTROL, 500000);
+    run(2000000, 777);
+
+    CHECK(fast.count >= 1999 && fast.count <= 2001);
+    CHECK(Timer0.getInterruptCount() - interrupts <= fast.count + slow.count + 1);
+    CHECK_EQUAL(2, slow.count);
+    for (int i = 1; i < 64; i++) {
+        CHECK_EQUAL(1000, fast.times[i] - fast.times[i - 1]);
+    }
+    CHECK_EQUAL(250, fast.times[0] % 1000);
+
+    tickHandler.detach(&fast);
+    tickHandler.detach(&slow);
+}
+
+/*
+ * Attaching an observer with an earlier deadline re-programs the running timer.
+ */
+static void testEarlierDeadline()
+{
+    TestObserver slow, fast;
+
+    tickHandler.attach(&slow, 10000000, TickHandler::PRIORITY_INTERRUPT, 0);
+    run(100000);
+    uint32_t now = Clock::micros();
+    tickHandler.attach(&fast, 20000, TickHandler::PRIORITY_INTERRUPT, 5000);
+    run(50000);
+
+    CHECK_EQUAL(3, fast.count);
+    CHECK_EQUAL(5000, fast.times[0] % 20000);
+    CHECK(fast.times[0] - now <= 20000);
+
+    tickHandler.detach(&slow);
+    tickHandler.detach(&fast);
+}
+
+/*
+ * reschedule() moves the next tick to the delay and the timer follows it.
+ */
+static void testReschedule()
+{
+    TestObserver observer;
+
+    tickHandler.attach(&observer, 1000000, TickHandler::PRIORITY_INTERRUPT, 0);
+    run(10000);
+    uint32_t now = Clock::micros();
+    tickHandler.reschedule(&observer, 3000);
+    run(10000, 100);
+
+    CHECK_EQUAL(1, observer.count);
+    CHECK_EQUAL(now + 3000, observer.times[0]);
+
+    tickHandler.detach(&observer);
+}
+
+/*
+ * Auto-phased observers are placed in the largest gap without moving the ticks
+ * of the observers which are already attached (no skipped or doubled tick, a
+ * pending reschedule is kept).
+ */
+static void testAutoPhase()
+{
+    TestObserver a, b, c, d;
+
+    tickHandler.attach(&a, 1000000, TickHandler::PRIORITY_INTERRUPT);
+    run(1500000);
+    tickHandler.attach(&b, 1000000, TickHandler::PRIORITY_INTERRUPT);
+    run(1000000);
+    uint32_t now = Clock::micros();
+    tickHandler.reschedule(&b, 100000);
+    tickHandler.attach(&c, 1000000, TickHandler::PRIORITY_INTERRUPT);
+    tickHandler.attach(&d, 1000000, TickHandler::PRIORITY_INTERRUPT);
+    run(3000000);
+
+    for (uint32_t i = 1; i < a.count; i++) {
+        CHECK_EQUAL(1000000, a.times[i] - a.times[i - 1]);
+    }
+    CHECK_EQUAL(0, a.times[0] % 1000000);
+    CHECK_EQUAL(now + 100000, b.times[1]);
+    for (uint32_t i = 2; i < b.count; i++) { // back to its phase after the rescheduled tick
+        CHECK_EQUAL(500000, b.times[i] % 1000000);
+    }
+    CHECK_EQUAL(500000, b.times[0] % 1000000);
+    CHECK_EQUAL(750000, c.times[0] % 1000000);
+    CHECK_EQUAL(250000, d.times[0] % 1000000);
+
+    tickHandler.detach(&a);
+    tickHandler.detach(&b);
+    tickHandler.detach(&c);
+    tickHandler.detach(&d);
+}
+
+int main()
+{
+    Host::setManualTime(true);
+    Host::setOutput(false);
+
+    RUN_TEST(testCoprimePhases);
+    RUN_TEST(testExactPeriod);
+    RUN_TEST(testEarlierDeadline);
+    RUN_TEST(testReschedule);
+    RUN_TEST(testAutoPhase);
+
+    return testResult();
+}
@@ -0,0 +1,288 @@
+/*
+ * Arduino.cpp
+ *
+ * Host stand-in for the Arduino core of the Due (see Arduino.h).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <Arduino.h>
+#include <DueTimer.h>
+#include <time.h>
+
+Serial_ SerialUSB;
+Serial_ Serial;
+
+static bool manualTime = false;
+static uint64_t manualMicros = 0;
+static uint32_t primask = 0;
+static bool output = true;
+
+/*
+ * Real monotonic time in microseconds since the first call.
+ */
+static uint64_t realMicros()
+{
+    static uint64_t start = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t time = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    if (start == 0) {
+        start = time;
+    }
+    return time - start;
+}
+
+/*
+ * The current host time in microseconds (manual or real).
+ */
+uint64_t hostTime()
+{
+    return manualTime ? manualMicros : realMicros();
+}
+
+/*
+ * Set the manual time (used by the timer stand-in when it fires).
+ */
+void setHostTime(uint64_t time)
+{
+    manualMicros = time;
+}
+
+uint32_t millis()
+{
+    return (uint32_t) (hostTime() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t) hostTime();
+}
+
+/*
+ * With manual time the time is advanced (firing the timers), otherwise the host sleeps.
+ */
+void delay(uint32_t milliseconds)
+{
+    delayMicroseconds(milliseconds * 1000);
+}
+
+void delayMicroseconds(uint32_t microseconds)
+{
+    if (manualTime) {
+        Host::advance(microseconds);
+    } else {
+        struct timespec wait = { (time_t) (microseconds / 1000000), (long) (microseconds % 1000000) * 1000 };
+        nanosleep(&wait, NULL);
+    }
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh)
+{
+    return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+}
+
+int digitalRead(uint32_t pin)
+{
+    return HIGH;
+}
+
+uint32_t analogRead(uint32_t pin)
+{
+    return 0;
+}
+
+void analogWrite(uint32_t pin, uint32_t value)
+{
+}
+
+uint32_t digitalPinToInterrupt(uint32_t pin)
+{
+    return pin;
+}
+
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode)
+{
+}
+
+void detachInterrupt(uint32_t pin)
+{
+}
+
+void noInterrupts()
+{
+    primask = 1;
+}
+
+void interrupts()
+{
+    primask = 0;
+}
+
+uint32_t __get_PRIMASK()
+{
+    return primask;
+}
+
+void __set_PRIMASK(uint32_t value)
+{
+    primask = value;
+}
+
+void __disable_irq()
+{
+    primask = 1;
+}
+
+void __enable_irq()
+{
+    primask = 0;
+}
+
+void __WFI()
+{
+}
+
+void Serial_::begin(uint32_t baud)
+{
+}
+
+int Serial_::available()
+{
+    return 0;
+}
+
+int Serial_::read()
+{
+    return -1;
+}
+
+size_t Serial_::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t Serial_::write(const uint8_t *buffer, size_t size)
+{
+    if (output) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+size_t Serial_::print(const char *text)
+{
+    return write((const uint8_t *) text, strlen(text));
+}
+
+size_t Serial_::print(char value)
+{
+    return write((uint8_t) value);
+}
+
+size_t Serial_::print(int value, int base)
+{
+    return print((long) value, base);
+}
+
+size_t Serial_::print(unsigned int value, int base)
+{
+    return print((unsigned long) value, base);
+}
+
+size_t Serial_::print(long value, int base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%ld", value);
+    return print(buffer);
+}
+
+size_t Serial_::print(unsigned long value, int base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", value);
+    return print(buffer);
+}
+
+size_t Serial_::print(double value, int digits)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return print(buffer);
+}
+
+size_t Serial_::println(const char *text)
+{
+    return print(text) + println();
+}
+
+size_t Serial_::println()
+{
+    return print("\n");
+}
+
+namespace Host
+{
+
+/*
+ * Switch between the real time of the host and a manual time which starts at 0.
+ */
+void setManualTime(bool manual)
+{
+    manualTime = manual;
+    manualMicros = 0;
+}
+
+/*
+ * Move the manual time forward. All timer interrupts which become due on the way are
+ * fired at their exact time (if interrupts are enabled).
+ */
+void advance(uint32_t microseconds)
+{
+    uint64_t target = manualMicros + microseconds;
+
+    while (primask == 0 && DueTimer::fireNext(target)) {
+    }
+    manualMicros = target;
+}
+
+void setOutput(bool enabled)
+{
+    output = enabled;
+}
+
+bool interruptsEnabled()
+{
+    return primask == 0;
+}
+
+}
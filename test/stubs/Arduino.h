@@ -0,0 +1,124 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in for the Arduino core of the Due, used to build and test the
+ * sketch on a PC (see test/Makefile). Only the functions used by the sketch are
+ * provided. The time is either the real monotonic time of the host or a manual
+ * time which only moves when a test calls Host::advance(). Advancing the manual
+ * time fires the interrupts of the timers (see DueTimer.h) which become due.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <type_traits>
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint8_t U8; // from the SAM headers
+typedef uint16_t U16;
+typedef uint32_t U32;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+#define DEC 10
+#define HEX 16
+
+// functions instead of the macros of the Arduino core, so the arguments are evaluated once
+template<class T, class U> inline auto min(T a, U b) -> typename std::remove_reference<decltype(a < b ? a : b)>::type { return a < b ? a : b; }
+template<class T, class U> inline auto max(T a, U b) -> typename std::remove_reference<decltype(a > b ? a : b)>::type { return a > b ? a : b; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t milliseconds);
+void delayMicroseconds(uint32_t microseconds);
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+uint32_t analogRead(uint32_t pin);
+void analogWrite(uint32_t pin, uint32_t value);
+uint32_t digitalPinToInterrupt(uint32_t pin);
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode);
+void detachInterrupt(uint32_t pin);
+
+void noInterrupts();
+void interrupts();
+uint32_t __get_PRIMASK();
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq();
+void __enable_irq();
+void __WFI();
+
+class Serial_
+{
+public:
+    void begin(uint32_t baud);
+    int available();
+    int read();
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t print(const char *text);
+    size_t print(char value);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println(const char *text);
+    size_t println();
+    operator bool() { return true; }
+};
+
+extern Serial_ SerialUSB;
+extern Serial_ Serial;
+
+/*
+ * Control of the simulated hardware, only available in the host build.
+ */
+namespace Host
+{
+void setManualTime(bool manual); // switch between real time (default) and manual time starting at 0
+void advance(uint32_t microseconds); // move the manual time forward, firing all timer interrupts on the way
+void setOutput(bool enabled); // enable/disable the output of SerialUSB to stdout
+bool interruptsEnabled();
+}
+
+#endif /* ARDUINO_H_ */
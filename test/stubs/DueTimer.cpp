@@ -0,0 +1,144 @@
+/*
+ * DueTimer.cpp
+ *
+ * Host stand-in for the DueTimer library (see DueTimer.h).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "DueTimer.h"
+
+uint64_t hostTime(); // see Arduino.cpp
+void setHostTime(uint64_t time);
+
+DueTimer Timer0, Timer1, Timer2, Timer3, Timer4, Timer5, Timer6, Timer7, Timer8;
+static DueTimer *timers[] = { &Timer0, &Timer1, &Timer2, &Timer3, &Timer4, &Timer5, &Timer6, &Timer7, &Timer8 };
+
+DueTimer::DueTimer()
+{
+    isr = NULL;
+    period = 1000;
+    running = false;
+    expiry = 0;
+    interruptCount = 0;
+}
+
+DueTimer &DueTimer::attachInterrupt(void (*isr)())
+{
+    this->isr = isr;
+    return *this;
+}
+
+DueTimer &DueTimer::detachInterrupt()
+{
+    isr = NULL;
+    return *this;
+}
+
+/*
+ * Start the timer (again), like on the hardware the counter restarts at 0.
+ */
+DueTimer &DueTimer::start(long microseconds)
+{
+    if (microseconds > 0) {
+        setPeriod(microseconds);
+    }
+    running = true;
+    expiry = hostTime() + period;
+    return *this;
+}
+
+DueTimer &DueTimer::stop()
+{
+    running = false;
+    return *this;
+}
+
+DueTimer &DueTimer::setFrequency(double frequency)
+{
+    period = (uint32_t) (1000000.0 / frequency);
+    if (period == 0) {
+        period = 1;
+    }
+    return *this;
+}
+
+DueTimer &DueTimer::setPeriod(unsigned long microseconds)
+{
+    period = (microseconds == 0 ? 1 : microseconds);
+    return *this;
+}
+
+double DueTimer::getFrequency()
+{
+    return 1000000.0 / period;
+}
+
+long DueTimer::getPeriod()
+{
+    return period;
+}
+
+bool DueTimer::isRunning()
+{
+    return running;
+}
+
+/*
+ * Number of interrupts fired so far.
+ */
+uint32_t DueTimer::getInterruptCount()
+{
+    return interruptCount;
+}
+
+/*
+ * Find the running timer which expires first until the given manual time, set the
+ * time to its expiry and call its interrupt function with interrupts disabled.
+ * Returns false if no timer is due.
+ */
+bool DueTimer::fireNext(uint64_t until)
+{
+    DueTimer *next = NULL;
+
+    for (unsigned int i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        if (timers[i]->running && timers[i]->expiry <= until && (next == NULL || timers[i]->expiry < next->expiry)) {
+            next = timers[i];
+        }
+    }
+    if (next == NULL) {
+        return false;
+    }
+
+    uint64_t expiry = next->expiry;
+    next->expiry += next->period;
+    setHostTime(expiry);
+    next->interruptCount++;
+    if (next->isr != NULL) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        next->isr();
+        __set_PRIMASK(primask);
+    }
+    return true;
+}
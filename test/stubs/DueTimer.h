@@ -0,0 +1,64 @@
+/*
+ * DueTimer.h
+ *
+ * Host stand-in for the DueTimer library. The timers behave like the
+ * periodic hardware timers of the Due: start() (re)starts the counter and the
+ * interrupt function is called every period. On the host the interrupts are only
+ * fired when the manual time is advanced (see Host::advance() in Arduino.h).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef DUETIMER_H_
+#define DUETIMER_H_
+
+#include <Arduino.h>
+
+class DueTimer
+{
+public:
+    DueTimer();
+    DueTimer &attachInterrupt(void (*isr)());
+    DueTimer &detachInterrupt();
+    DueTimer &start(long microseconds = -1);
+    DueTimer &stop();
+    DueTimer &setFrequency(double frequency);
+    DueTimer &setPeriod(unsigned long microseconds);
+    double getFrequency();
+    long getPeriod();
+    bool isRunning();
+    uint32_t getInterruptCount();
+
+    static bool fireNext(uint64_t until); // host only: fire the earliest interrupt which is due until the given time
+
+private:
+    void (*isr)();
+    uint32_t period; // microseconds
+    bool running;
+    uint64_t expiry; // manual time of the next interrupt
+    uint32_t interruptCount; // number of fired interrupts
+};
+
+extern DueTimer Timer0, Timer1, Timer2, Timer3, Timer4, Timer5, Timer6, Timer7, Timer8;
+
+#endif /* DUETIMER_H_ */
@@ -0,0 +1,50 @@
+/*
+ * OneWire.h
+ *
+ * Host stand-in for the OneWire library, no sensor is connected.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ONEWIRE_H_
+#define ONEWIRE_H_
+
+#include <Arduino.h>
+
+class OneWire
+{
+public:
+    OneWire(uint8_t pin) {}
+    uint8_t reset() { return 0; }
+    void select(const uint8_t *rom) {}
+    void skip() {}
+    void write(uint8_t value, uint8_t power = 0) {}
+    uint8_t read() { return 0xff; }
+    void read_bytes(uint8_t *buffer, uint16_t count) { memset(buffer, 0xff, count); }
+    void reset_search() {}
+    uint8_t search(uint8_t *address) { return 0; }
+    void depower() {}
+    static uint8_t crc8(const uint8_t *address, uint8_t length) { return 0; }
+};
+
+#endif /* ONEWIRE_H_ */
@@ -0,0 +1,192 @@
+/*
+ * due_can.cpp
+ *
+ * Host stand-in for the due_can library (see due_can.h).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "due_can.h"
+
+CANRaw CAN;
+CANRaw CAN2;
+
+CANRaw::CANRaw()
+{
+    memset(mailbox, 0, sizeof(mailbox));
+    numTxBoxes = 1;
+    callback = NULL;
+    sentCount = 0;
+    status = rxErrors = txErrors = 0;
+}
+
+uint32_t CANRaw::init(uint32_t baudRate)
+{
+    return 1;
+}
+
+/*
+ * The last mailboxes are used for transmission, like in the real library.
+ */
+void CANRaw::setNumTXBoxes(int txBoxes)
+{
+    numTxBoxes = constrain(txBoxes, 0, CANMB_NUMBER);
+    for (int i = 0; i < CANMB_NUMBER; i++) {
+        mailbox[i].mode = (i >= CANMB_NUMBER - numTxBoxes ? CAN_MB_TX_MODE : CAN_MB_RX_MODE);
+        mailbox[i].busy = false;
+    }
+}
+
+void CANRaw::setGeneralCallback(void (*callback)(CAN_FRAME *))
+{
+    this->callback = callback;
+}
+
+void CANRaw::mailbox_set_mode(uint8_t mailbox, uint8_t mode)
+{
+    if (mailbox < CANMB_NUMBER) {
+        this->mailbox[mailbox].mode = mode;
+    }
+}
+
+/*
+ * A tx mailbox reports ready (MRDY) while it doesn't hold a frame.
+ */
+uint32_t CANRaw::mailbox_get_status(uint8_t mailbox)
+{
+    if (mailbox >= CANMB_NUMBER || this->mailbox[mailbox].mode != CAN_MB_TX_MODE) {
+        return 0;
+    }
+    return this->mailbox[mailbox].busy ? 0 : CAN_MSR_MRDY;
+}
+
+int CANRaw::setRXFilter(uint8_t mailbox, uint32_t id, uint32_t mask, bool extended)
+{
+    if (mailbox >= CANMB_NUMBER) {
+        return -1;
+    }
+    this->mailbox[mailbox].id = id;
+    this->mailbox[mailbox].mask = mask;
+    this->mailbox[mailbox].extended = extended;
+    return mailbox;
+}
+
+/*
+ * Put the frame into the first free tx mailbox, fails if all are busy.
+ */
+bool CANRaw::sendFrame(CAN_FRAME &frame)
+{
+    for (int i = CANMB_NUMBER - numTxBoxes; i < CANMB_NUMBER; i++) {
+        if (mailbox[i].mode == CAN_MB_TX_MODE && !mailbox[i].busy) {
+            mailbox[i].frame = frame;
+            mailbox[i].busy = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t CANRaw::get_status()
+{
+    return status;
+}
+
+uint32_t CANRaw::get_rx_error_cnt()
+{
+    return rxErrors;
+}
+
+uint32_t CANRaw::get_tx_error_cnt()
+{
+    return txErrors;
+}
+
+/*
+ * Deliver a frame from the bus: if an enabled rx mailbox accepts it, the
+ * general callback is called like from the CAN interrupt.
+ */
+bool CANRaw::receiveFrame(CAN_FRAME &frame)
+{
+    for (int i = 0; i < CANMB_NUMBER - numTxBoxes; i++) {
+        Mailbox *box = &mailbox[i];
+
+        if (box->mode == CAN_MB_RX_MODE && box->extended == (frame.extended != 0) && ((frame.id ^ box->id) & box->mask) == 0) {
+            if (callback != NULL) {
+                uint32_t primask = __get_PRIMASK();
+                __disable_irq();
+                callback(&frame);
+                __set_PRIMASK(primask);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Send the frame of the busy tx mailbox which wins the arbitration (lowest id)
+ * and free its mailbox. Returns false if no frame is waiting.
+ */
+bool CANRaw::completeTransmission(CAN_FRAME *frame)
+{
+    Mailbox *winner = NULL;
+
+    for (int i = CANMB_NUMBER - numTxBoxes; i < CANMB_NUMBER; i++) {
+        if (mailbox[i].busy && (winner == NULL || mailbox[i].frame.id < winner->frame.id)) {
+            winner = &mailbox[i];
+        }
+    }
+    if (winner == NULL) {
+        return false;
+    }
+    if (frame != NULL) {
+        *frame = winner->frame;
+    }
+    winner->busy = false;
+    sentCount++;
+    return true;
+}
+
+uint8_t CANRaw::getBusyTxMailboxes()
+{
+    uint8_t count = 0;
+
+    for (int i = CANMB_NUMBER - numTxBoxes; i < CANMB_NUMBER; i++) {
+        if (mailbox[i].busy) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t CANRaw::getSentCount()
+{
+    return sentCount;
+}
+
+void CANRaw::setStatus(uint32_t status, uint32_t rxErrors, uint32_t txErrors)
+{
+    this->status = status;
+    this->rxErrors = rxErrors;
+    this->txErrors = txErrors;
+}
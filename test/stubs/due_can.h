@@ -0,0 +1,126 @@
+/*
+ * due_can.h
+ *
+ * Host stand-in for the due_can library. A CANRaw object emulates the
+ * 8 mailboxes of a CAN controller: rx mailboxes with acceptance filters and tx
+ * mailboxes which stay busy until the test completes the transmission (the frame
+ * with the lowest id wins the arbitration like on a real bus).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef DUE_CAN_H_
+#define DUE_CAN_H_
+
+#include <Arduino.h>
+
+#define CAN_BPS_1000K 1000000
+#define CAN_BPS_500K 500000
+#define CAN_BPS_250K 250000
+#define CAN_BPS_125K 125000
+#define CAN_BPS_33333 33333
+
+#define CAN_MB_DISABLE_MODE 0
+#define CAN_MB_RX_MODE 1
+#define CAN_MB_TX_MODE 3
+
+#define CAN_MSR_MRDY (0x1u << 23)
+#define CAN_SR_ERRP (0x1u << 18)
+#define CAN_SR_BOFF (0x1u << 19)
+
+#define CANMB_NUMBER 8
+
+typedef union
+{
+    uint64_t value;
+    struct
+    {
+        uint32_t low;
+        uint32_t high;
+    };
+    struct
+    {
+        uint16_t s0;
+        uint16_t s1;
+        uint16_t s2;
+        uint16_t s3;
+    };
+    uint8_t bytes[8];
+    uint8_t byte[8];
+} BytesUnion;
+
+typedef struct
+{
+    uint32_t id; // EID if ide set, SID otherwise
+    uint32_t fid; // family ID
+    uint8_t rtr; // remote transmission request
+    uint8_t priority; // priority but only important for TX frames
+    uint8_t extended; // extended ID flag
+    uint16_t time; // CAN timer value when mailbox message was received
+    uint8_t length; // number of data bytes
+    BytesUnion data; // 64 bits - lots of ways to access it
+} CAN_FRAME;
+
+class CANRaw
+{
+public:
+    CANRaw();
+    uint32_t init(uint32_t baudRate);
+    void setNumTXBoxes(int txBoxes);
+    void setGeneralCallback(void (*callback)(CAN_FRAME *));
+    void mailbox_set_mode(uint8_t mailbox, uint8_t mode);
+    uint32_t mailbox_get_status(uint8_t mailbox);
+    int setRXFilter(uint8_t mailbox, uint32_t id, uint32_t mask, bool extended);
+    bool sendFrame(CAN_FRAME &frame);
+    uint32_t get_status();
+    uint32_t get_rx_error_cnt();
+    uint32_t get_tx_error_cnt();
+
+    // host only
+    bool receiveFrame(CAN_FRAME &frame);
+    bool completeTransmission(CAN_FRAME *frame = NULL);
+    uint8_t getBusyTxMailboxes();
+    uint32_t getSentCount();
+    void setStatus(uint32_t status, uint32_t rxErrors, uint32_t txErrors);
+
+private:
+    struct Mailbox
+    {
+        uint8_t mode;
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+        bool busy; // tx mailbox holds a frame which is not sent yet
+        CAN_FRAME frame;
+    };
+    Mailbox mailbox[CANMB_NUMBER];
+    uint8_t numTxBoxes;
+    void (*callback)(CAN_FRAME *);
+    uint32_t sentCount;
+    uint32_t status, rxErrors, txErrors;
+};
+
+extern CANRaw CAN;
+extern CANRaw CAN2;
+
+#endif /* DUE_CAN_H_ */
@@ -0,0 +1,105 @@
+/*
+ * due_wire.cpp
+ *
+ * Host stand-in for the Wire library of the Due (see due_wire.h).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "due_wire.h"
+
+TwoWire Wire;
+
+TwoWire::TwoWire()
+{
+    memset(memory, 0xff, sizeof(memory));
+    chip = 0;
+    address = 0;
+    txLength = 0;
+    rxAvailable = 0;
+}
+
+void TwoWire::begin()
+{
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    chip = address & 0x03;
+    txLength = 0;
+}
+
+/*
+ * The first two bytes of a transmission set the address pointer, the rest is written.
+ */
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    if (txLength >= 2) {
+        address = (txBuffer[0] << 8) | txBuffer[1];
+        for (int i = 2; i < txLength; i++) {
+            memory[chip][(uint16_t) (address + i - 2)] = txBuffer[i];
+        }
+    }
+    txLength = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, int quantity)
+{
+    chip = address & 0x03;
+    rxAvailable = quantity;
+    return quantity;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+    if (txLength < sizeof(txBuffer)) {
+        txBuffer[txLength++] = value;
+        return 1;
+    }
+    return 0;
+}
+
+size_t TwoWire::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+
+    while (written < size && write(buffer[written])) {
+        written++;
+    }
+    return written;
+}
+
+int TwoWire::available()
+{
+    return rxAvailable;
+}
+
+int TwoWire::read()
+{
+    if (rxAvailable == 0) {
+        return -1;
+    }
+    rxAvailable--;
+    return memory[chip][address++];
+}
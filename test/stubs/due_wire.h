@@ -0,0 +1,59 @@
+/*
+ * due_wire.h
+ *
+ * Host stand-in for the Wire library of the Due. Emulates the 24LC256 type
+ * EEPROMs used by MemCache (4 chips with 64kB each, erased to 0xff).
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef DUE_WIRE_H_
+#define DUE_WIRE_H_
+
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+    TwoWire();
+    void begin();
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, int quantity);
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available();
+    int read();
+
+private:
+    uint8_t memory[4][0x10000];
+    uint8_t chip; // selected EEPROM
+    uint16_t address; // address pointer of the selected EEPROM
+    uint8_t txBuffer[260];
+    uint16_t txLength;
+    int rxAvailable;
+};
+
+extern TwoWire Wire;
+
+#endif /* DUE_WIRE_H_ */